@@ -0,0 +1,115 @@
+#pragma once
+
+// Board profiles: pins, charger slots and the door lock, resolved at compile time.
+// Pick one per PlatformIO env with -DBOARD_<NAME> in build_flags.
+
+#include <stdint.h>
+
+struct SlotConfig {
+  uint8_t relay_pin;
+  const char *name;       // Charger menu label
+};
+
+// RFID readers share HSPI, each on its own chip select
+struct ReaderConfig {
+  uint8_t ss_pin;
+  uint8_t rst_pin;        // 0xff: not wired (MFRC522::UNUSED_PIN)
+  int8_t slot;            // Index in SLOTS a bay reader preselects, -1 for the front panel
+};
+
+#if defined(BOARD_STATION_V2) || defined(BOARD_STATION_V2_BAYS)
+
+// EV charging station V2, az-delivery-devkit-v4
+constexpr int RFID_SCK  = 14;
+constexpr int RFID_MISO = 12;
+constexpr int RFID_MOSI = 13;
+constexpr int RFID_SS   = 15;  // Front panel reader
+constexpr uint8_t RFID_RST = 0xff;
+
+#if defined(BOARD_READERS_FILE)
+// Readers defined elsewhere, e.g. the host simulations in test/
+#include BOARD_READERS_FILE
+#elif defined(BOARD_STATION_V2_BAYS)
+// V2 with the bay readers fitted at the two main chargers
+constexpr ReaderConfig READERS[] = {
+  {RFID_SS, RFID_RST, -1},
+  {4, RFID_RST, 0},   // Charger 60V
+  {21, RFID_RST, 1},  // Charger 72V
+};
+#else
+// Stock V2: the front panel reader only
+constexpr ReaderConfig READERS[] = {
+  {RFID_SS, RFID_RST, -1},
+};
+#endif
+
+constexpr int SD_CS = 5;
+
+constexpr int BUTTON_L = 33;
+constexpr int BUTTON_C = 34;
+constexpr int BUTTON_R = 35;
+constexpr int DOOR_SENSOR = 17;
+
+constexpr SlotConfig SLOTS[] = {
+  {27, "Charger 60V"},
+  {25, "Charger 72V"},
+  {32, "Slot Charger"},
+  {26, "Charger Baterai"},
+};
+
+// The battery charger sits behind a door lock on its own relay
+constexpr int DOOR_LOCK_SLOT = 3;  // Index in SLOTS, -1 without a door lock
+constexpr int DOOR_LOCK_PIN = 16;
+
+#else
+#error "No board profile selected, add -DBOARD_<NAME> to build_flags"
+#endif
+
+constexpr int SLOT_COUNT = sizeof(SLOTS) / sizeof(SLOTS[0]);
+constexpr bool HAS_DOOR_LOCK = DOOR_LOCK_SLOT >= 0;
+constexpr int READER_COUNT = sizeof(READERS) / sizeof(READERS[0]);
+
+// No two slots may drive the same relay, nor the door lock
+constexpr bool slotPinFreeFrom(int i, int j) {
+  return j >= SLOT_COUNT ? (!HAS_DOOR_LOCK || SLOTS[i].relay_pin != DOOR_LOCK_PIN)
+                         : SLOTS[i].relay_pin != SLOTS[j].relay_pin && slotPinFreeFrom(i, j + 1);
+}
+
+constexpr bool slotPinsUnique(int i = 0) {
+  return i >= SLOT_COUNT ? true : slotPinFreeFrom(i, i + 1) && slotPinsUnique(i + 1);
+}
+
+static_assert(SLOT_COUNT > 0, "a board needs at least one charger slot");
+static_assert(DOOR_LOCK_SLOT < SLOT_COUNT, "door lock slot out of range");
+static_assert(slotPinsUnique(), "relay pin used twice");
+
+// Bay readers preselect a slot that exists, no two readers share a chip select
+constexpr bool readerSlotsValid(int i = 0) {
+  return i >= READER_COUNT ? true
+                           : READERS[i].slot >= -1 && READERS[i].slot < SLOT_COUNT && readerSlotsValid(i + 1);
+}
+
+constexpr bool readerPinFreeFrom(int i, int j) {
+  return j >= READER_COUNT ? true : READERS[i].ss_pin != READERS[j].ss_pin && readerPinFreeFrom(i, j + 1);
+}
+
+constexpr bool readerPinsUnique(int i = 0) {
+  return i >= READER_COUNT ? true : readerPinFreeFrom(i, i + 1) && readerPinsUnique(i + 1);
+}
+
+// A chip select must not double as a relay, input, SD or RFID bus pin
+constexpr bool readerPinFreeFromBoard(int pin, int slot = 0) {
+  return slot < SLOT_COUNT ? pin != SLOTS[slot].relay_pin && readerPinFreeFromBoard(pin, slot + 1)
+                           : pin != SD_CS && pin != BUTTON_L && pin != BUTTON_C && pin != BUTTON_R &&
+                             pin != DOOR_SENSOR && (!HAS_DOOR_LOCK || pin != DOOR_LOCK_PIN) &&
+                             pin != RFID_SCK && pin != RFID_MISO && pin != RFID_MOSI;
+}
+
+constexpr bool readerPinsFree(int i = 0) {
+  return i >= READER_COUNT ? true : readerPinFreeFromBoard(READERS[i].ss_pin) && readerPinsFree(i + 1);
+}
+
+static_assert(READER_COUNT > 0, "a board needs at least one RFID reader");
+static_assert(readerSlotsValid(), "reader slot out of range");
+static_assert(readerPinsUnique(), "reader chip select used twice");
+static_assert(readerPinsFree(), "reader chip select shared with another board pin");
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Same stable-interval debounce as Bounce2's default mode
+class Bounce {
+public:
+  void attach(int pin, int mode) {
+    pinMode(pin, mode);
+    attach(pin);
+  }
+
+  void attach(int pin);
+  void interval(uint16_t interval_millis) { _interval = interval_millis; }
+  bool update();
+  bool read() const { return _stable; }
+  bool changed() const { return _changed; }
+  bool fell() const { return _changed && !_stable; }
+  bool rose() const { return _changed && _stable; }
+
+private:
+  int _pin = -1;
+  uint16_t _interval = 10;
+  bool _stable = false;
+  bool _unstable = false;
+  bool _changed = false;
+  unsigned long _previous = 0;
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+// Base of the network clients; the fakes carry no connection in it
+class Client {
+public:
+  virtual ~Client() {}
+};
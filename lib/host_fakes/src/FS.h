@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FileHandle;
+
+// Copies share one open file, as with the arduino-esp32 FileImpl
+class File : public Stream {
+public:
+  File() {}
+  explicit File(std::shared_ptr<FileHandle> handle) : _handle(handle) {}
+
+  operator bool() const;
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *buffer, size_t size);
+  void flush();
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char *name() const;
+
+private:
+  std::shared_ptr<FileHandle> _handle;
+};
+
+// Files under a host directory, see fakeSdRoot()
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *path_from, const char *path_to);
+
+protected:
+  bool _mounted = false;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
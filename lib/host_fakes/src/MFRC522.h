@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// Simulated reader: the card in its field comes from fakeCardTap(), keyed by
+// the chip select pin the object was constructed with
+class MFRC522 {
+public:
+  enum StatusCode : byte {
+    STATUS_OK,
+    STATUS_ERROR,
+    STATUS_COLLISION,
+    STATUS_TIMEOUT,
+    STATUS_NO_ROOM,
+    STATUS_INTERNAL_ERROR,
+    STATUS_INVALID,
+    STATUS_CRC_WRONG,
+    STATUS_MIFARE_NACK = 0xff
+  };
+
+  typedef struct {
+    byte size;
+    byte uidByte[10];
+    byte sak;
+  } Uid;
+
+  Uid uid;
+
+  MFRC522() : MFRC522(SS, 0xff) {}
+  MFRC522(byte chipSelectPin, byte resetPowerDownPin);
+
+  void PCD_Init();
+  void PCD_Init(byte chipSelectPin, byte resetPowerDownPin);
+  bool PICC_IsNewCardPresent();
+  bool PICC_ReadCardSerial();
+  StatusCode PICC_HaltA();
+  void PCD_StopCrypto1() {}
+
+private:
+  byte _chipSelectPin;
+  byte _resetPowerDownPin;
+};
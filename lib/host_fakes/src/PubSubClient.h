@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+#define MQTT_CONNECTED 0
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECT_FAILED -2
+
+// MQTT client against the recording broker in fake_wifi.cpp: connects while
+// WiFi and the broker are up (fakeMqttBrokerUp()) and drops when either goes
+// down. A publish larger than the buffer fails, as in PubSubClient.
+class PubSubClient {
+public:
+  PubSubClient(Client &client);
+
+  PubSubClient &setServer(const char *domain, uint16_t port);
+  bool setBufferSize(uint16_t size);
+  PubSubClient &setSocketTimeout(uint16_t timeout);
+
+  bool connect(const char *id);
+  void disconnect();
+  bool connected();
+  bool loop();
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length);
+  int state();
+
+private:
+  uint16_t _buffer_size;
+  bool _connected;
+  uint32_t _session;              // Broker session the connection belongs to
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <FS.h>
+#include <SPI.h>
+
+class SDFS : public fs::FS {
+public:
+  bool begin(uint8_t ssPin = SS, SPIClass &spi = SPI, uint32_t frequency = 4000000,
+             const char *mountpoint = "/sd", uint8_t max_files = 5, bool format_if_empty = false);
+  void end() { _mounted = false; }
+  uint64_t cardSize() { return _mounted ? 4ULL << 30 : 0; }
+};
+
+extern SDFS SD;
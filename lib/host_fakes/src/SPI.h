@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define FSPI 1
+#define HSPI 2
+#define VSPI 3
+
+// Records which core started each bus object, see fakeSpiStarts()
+class SPIClass {
+public:
+  SPIClass(uint8_t spi_bus = HSPI) : _bus(spi_bus), _started(false) {}
+
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+  void end() { _started = false; }
+  uint8_t bus() const { return _bus; }
+
+private:
+  uint8_t _bus;
+  bool _started;
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// Panel setup as in the station's User_Setup.h
+#define TFT_WIDTH  320
+#define TFT_HEIGHT 480
+#define TFT_CS     2
+#define TFT_BL     22
+#define TFT_BACKLIGHT_ON HIGH
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKGREEN   0x03E0
+#define TFT_MAROON      0x7800
+#define TFT_LIGHTGREY   0xD69A
+#define TFT_DARKGREY    0x7BEF
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_CYAN        0x07FF
+#define TFT_RED         0xF800
+#define TFT_MAGENTA     0xF81F
+#define TFT_YELLOW      0xFFE0
+#define TFT_ORANGE      0xFDA0
+#define TFT_WHITE       0xFFFF
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+// Draws into a host framebuffer, see fakeTftPixel(). Shapes are broken down
+// into the same primitives TFT_eSPI uses, so subclasses that override the
+// primitives see the same calls as on the panel. Only the GLCD font is built in.
+class TFT_eSPI : public Print {
+public:
+  TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT);
+  virtual ~TFT_eSPI() {}
+
+  void init(uint8_t tc = 0);
+  void begin(uint8_t tc = 0) { init(tc); }
+  void setRotation(uint8_t r);
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  virtual void drawPixel(int32_t x, int32_t y, uint32_t color);
+  virtual void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color);
+  virtual void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color);
+  virtual void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  virtual void drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size);
+  virtual int16_t drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font);
+
+  void fillScreen(uint32_t color);
+  void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color);
+  void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color);
+  void fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color);
+
+  void startWrite() {}
+  void endWrite() {}
+  void setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h);
+  void pushBlock(uint16_t color, uint32_t len);
+
+  void setCursor(int16_t x, int16_t y) {
+    cursor_x = x;
+    cursor_y = y;
+  }
+  void setTextColor(uint16_t color) { textcolor = textbgcolor = color; }
+  void setTextColor(uint16_t fgcolor, uint16_t bgcolor, bool bgfill = false) {
+    (void)bgfill;
+    textcolor = fgcolor;
+    textbgcolor = bgcolor;
+  }
+  void setTextSize(uint8_t s) { textsize = s > 0 ? s : 1; }
+  void setTextDatum(uint8_t d) { textdatum = d; }
+  void setTextWrap(bool wrapX, bool wrapY = false) {
+    textwrapX = wrapX;
+    (void)wrapY;
+  }
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+protected:
+  void drawCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t cornername, uint32_t color);
+  void fillCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t cornername, int32_t delta, uint32_t color);
+
+  int32_t cursor_x = 0, cursor_y = 0;
+  uint32_t textcolor = TFT_WHITE, textbgcolor = TFT_WHITE;
+  uint8_t textfont = 1, textsize = 1, textdatum = TL_DATUM;
+  bool textwrapX = true;
+
+private:
+  void setPixel(int32_t x, int32_t y, uint16_t color);
+
+  int16_t _width, _height;
+  uint8_t _rotation = 0;
+  int32_t _win_x = 0, _win_y = 0, _win_w = 0, _win_h = 0;
+  uint32_t _win_pos = 0;
+  SPIClass _spi;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Station mode only. The link comes up with fakeWifiUp(); the MAC is fixed.
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1
+} wifi_mode_t;
+
+class WiFiClient : public Client {};
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode);
+  wl_status_t begin(const char *ssid, const char *password);
+  wl_status_t status();
+  bool setAutoReconnect(bool reconnect);
+  uint8_t *macAddress(uint8_t *mac);
+};
+
+extern WiFiClass WiFi;
+
+// SNTP is not simulated, set the wall clock with fakeSetEpoch()
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char *server1,
+                const char *server2 = NULL, const char *server3 = NULL);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Nothing on the I2C bus is used, the header only has to exist
+class TwoWire {
+public:
+  bool begin() { return true; }
+};
+
+extern TwoWire Wire;
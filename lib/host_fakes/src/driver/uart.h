@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_system.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0 0
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_system.h"
+#include "freertos/task.h"
+
+esp_err_t esp_task_wdt_init(uint32_t timeout_s, bool panic);
+esp_err_t esp_task_wdt_add(TaskHandle_t task);
+esp_err_t esp_task_wdt_delete(TaskHandle_t task);
+esp_err_t esp_task_wdt_reset();
@@ -0,0 +1,446 @@
+#include <Arduino.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <thread>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+// State lives on the heap and is never freed: task threads may still be
+// running while the process exits
+namespace {
+
+struct ClockState {
+  std::atomic<uint64_t> now_us{300000};  // setup() starts after the ROM and core boot
+  std::mutex events_mutex;
+  std::multimap<uint64_t, fake::Event> events;
+  time_t epoch = 0;              // Wall clock at epoch_set_us, 0 while unset
+  uint64_t epoch_set_us = 0;
+};
+
+ClockState &clockState() {
+  static ClockState *state = new ClockState;
+  return *state;
+}
+
+const int PIN_COUNT = 40;
+std::atomic<int> input_levels[PIN_COUNT];
+std::atomic<int> output_levels[PIN_COUNT];
+std::atomic<bool> pins_ready{false};
+
+void initPins() {
+  if (pins_ready) return;
+  for (int i = 0; i < PIN_COUNT; i++) {
+    input_levels[i] = HIGH;   // Inputs rest on their pull-ups
+    output_levels[i] = LOW;
+  }
+  pins_ready = true;
+}
+
+const size_t UART_FIFO_SIZE = 128;
+
+struct SerialState {
+  std::mutex mutex;
+  std::deque<char> rx;
+  std::string tx;
+  bool echo = false;
+  unsigned long baud = 115200;
+  uint64_t tx_done_us = 0;       // When the bytes written so far have left the FIFO
+  uint32_t flushes = 0;
+};
+
+SerialState &serialState() {
+  static SerialState *state = new SerialState;
+  return *state;
+}
+
+thread_local bool on_task = false;
+thread_local int current_core = 1;  // setup() and loop() run on core 1
+
+}  // namespace
+
+namespace fake {
+
+uint64_t nowUs() {
+  return clockState().now_us;
+}
+
+void storeNow(uint64_t us) {
+  if (us > clockState().now_us) clockState().now_us = us;
+}
+
+bool onTask() {
+  return on_task;
+}
+
+void markTask(int core) {
+  on_task = true;
+  current_core = core;
+}
+
+bool takeEvent(uint64_t until_us, uint64_t *at, Event *out) {
+  ClockState &state = clockState();
+  std::lock_guard<std::mutex> lock(state.events_mutex);
+  if (state.events.empty() || state.events.begin()->first > until_us) return false;
+  *at = state.events.begin()->first;
+  *out = state.events.begin()->second;
+  state.events.erase(state.events.begin());
+  return true;
+}
+
+bool nextEventAt(uint64_t *at) {
+  ClockState &state = clockState();
+  std::lock_guard<std::mutex> lock(state.events_mutex);
+  if (state.events.empty()) return false;
+  *at = state.events.begin()->first;
+  return true;
+}
+
+void applyEvent(const Event &event) {
+  switch (event.kind) {
+  case EVENT_PIN:
+    fakePin(event.pin, event.level);
+    break;
+  case EVENT_SERIAL:
+    serialReceive(event.text);
+    break;
+  case EVENT_TAP:
+    readerTap(event.pin, event.uid, event.uid_size);
+    break;
+  case EVENT_REMOVE:
+    readerRemove(event.pin);
+    break;
+  }
+}
+
+int inputLevel(uint8_t pin) {
+  initPins();
+  return pin < PIN_COUNT ? input_levels[pin].load() : LOW;
+}
+
+void serialReceive(const std::string &text) {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  serial.rx.insert(serial.rx.end(), text.begin(), text.end());
+}
+
+uint32_t serialTxPending() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  uint64_t now = nowUs();
+  if (serial.tx_done_us <= now) return 0;
+  return (uint32_t)((serial.tx_done_us - now) * serial.baud / 10 / 1000000) + 1;
+}
+
+}  // namespace fake
+
+static void schedule(unsigned long at_ms, const fake::Event &event) {
+  ClockState &state = clockState();
+  std::lock_guard<std::mutex> lock(state.events_mutex);
+  state.events.insert(std::make_pair((uint64_t)at_ms * 1000, event));
+}
+
+// Clock
+unsigned long millis() {
+  return (unsigned long)(fake::nowUs() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)fake::nowUs();
+}
+
+void delay(uint32_t ms) {
+  if (fake::onTask()) {
+    vTaskDelay(ms);
+    return;
+  }
+  fake::advanceTo(fake::nowUs() + (uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  fake::advanceTo(fake::nowUs() + us);
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void fakeAdvance(unsigned long ms) {
+  fake::advanceTo(fake::nowUs() + (uint64_t)ms * 1000);
+}
+
+uint64_t fakeNowUs() {
+  return fake::nowUs();
+}
+
+void fakeSetEpoch(time_t epoch) {
+  ClockState &state = clockState();
+  std::lock_guard<std::mutex> lock(state.events_mutex);
+  state.epoch = epoch;
+  state.epoch_set_us = fake::nowUs();
+}
+
+// Linked in place of time() with -Wl,--wrap=time: the wall clock follows the
+// fake clock and counts seconds of uptime until it is set, as on the ESP32
+extern "C" time_t __wrap_time(time_t *out) {
+  ClockState &state = clockState();
+  time_t now;
+  {
+    std::lock_guard<std::mutex> lock(state.events_mutex);
+    uint64_t now_us = fake::nowUs();
+    now = state.epoch != 0 ? state.epoch + (time_t)((now_us - state.epoch_set_us) / 1000000)
+                           : (time_t)(now_us / 1000000);
+  }
+  if (out != NULL) *out = now;
+  return now;
+}
+
+// Linked in place of settimeofday() with -Wl,--wrap=settimeofday: sets the
+// fake wall clock, whole seconds only
+extern "C" int __wrap_settimeofday(const struct timeval *tv, const void *tz) {
+  (void)tz;
+  if (tv == NULL) return -1;
+  fakeSetEpoch(tv->tv_sec);
+  return 0;
+}
+
+// Pins
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+  initPins();
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  initPins();
+  if (pin < PIN_COUNT) output_levels[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return fake::inputLevel(pin);
+}
+
+void fakePin(uint8_t pin, int level) {
+  initPins();
+  if (pin < PIN_COUNT) input_levels[pin] = level ? HIGH : LOW;
+}
+
+int fakePinOutput(uint8_t pin) {
+  initPins();
+  return pin < PIN_COUNT ? output_levels[pin].load() : LOW;
+}
+
+long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return min < max ? min + random(max - min) : min;
+}
+
+// Scheduled inputs
+void fakeSchedulePin(unsigned long at_ms, uint8_t pin, int level) {
+  fake::Event event = {fake::EVENT_PIN, pin, level, "", {0}, 0};
+  schedule(at_ms, event);
+}
+
+void fakeScheduleSerial(unsigned long at_ms, const char *text) {
+  fake::Event event = {fake::EVENT_SERIAL, 0, 0, text, {0}, 0};
+  schedule(at_ms, event);
+}
+
+void fakeScheduleTap(unsigned long at_ms, uint8_t ss_pin, const uint8_t *uid, uint8_t size) {
+  fake::Event event = {fake::EVENT_TAP, ss_pin, 0, "", {0}, size};
+  memcpy(event.uid, uid, size < sizeof(event.uid) ? size : sizeof(event.uid));
+  schedule(at_ms, event);
+}
+
+void fakeScheduleRemove(unsigned long at_ms, uint8_t ss_pin) {
+  fake::Event event = {fake::EVENT_REMOVE, ss_pin, 0, "", {0}, 0};
+  schedule(at_ms, event);
+}
+
+// Print and Stream
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    if (write(*buffer++) == 0) break;
+    n++;
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+
+  if ((size_t)len < sizeof(buffer)) return write((const uint8_t *)buffer, len);
+
+  std::string long_line(len + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&long_line[0], len + 1, format, args);
+  va_end(args);
+  return write((const uint8_t *)long_line.data(), len);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buffer[8 * sizeof(long) + 1];
+  char *str = &buffer[sizeof(buffer) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    int digit = n % base;
+    n /= base;
+    *--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(double n, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0) break;
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0 || c == terminator) break;
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+// Serial
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud) {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  serial.baud = baud;
+}
+
+int HardwareSerial::available() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  return (int)serial.rx.size();
+}
+
+int HardwareSerial::read() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  if (serial.rx.empty()) return -1;
+  char c = serial.rx.front();
+  serial.rx.pop_front();
+  return (uint8_t)c;
+}
+
+int HardwareSerial::peek() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  return serial.rx.empty() ? -1 : (uint8_t)serial.rx.front();
+}
+
+int HardwareSerial::availableForWrite() {
+  uint32_t pending = fake::serialTxPending();
+  return pending < UART_FIFO_SIZE ? (int)(UART_FIFO_SIZE - pending) : 0;
+}
+
+void HardwareSerial::flush() {
+  SerialState &serial = serialState();
+  uint64_t done;
+  {
+    std::lock_guard<std::mutex> lock(serial.mutex);
+    serial.flushes++;
+    done = serial.tx_done_us;
+  }
+  if (!fake::onTask() && done > fake::nowUs()) fake::advanceTo(done);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  SerialState &serial = serialState();
+  uint64_t wait_until = 0;
+  {
+    std::lock_guard<std::mutex> lock(serial.mutex);
+    serial.tx.append((const char *)buffer, size);
+    if (serial.echo) fwrite(buffer, 1, size, stdout);
+
+    uint64_t now = fake::nowUs();
+    uint64_t byte_us = 10 * 1000000ULL / serial.baud;
+    if (serial.tx_done_us < now) serial.tx_done_us = now;
+    serial.tx_done_us += size * byte_us;
+
+    // Without room in the FIFO the driver blocks until enough has gone out
+    uint64_t fifo_us = UART_FIFO_SIZE * byte_us;
+    if (serial.tx_done_us > now + fifo_us) wait_until = serial.tx_done_us - fifo_us;
+  }
+  if (wait_until != 0 && !fake::onTask()) fake::advanceTo(wait_until);
+  return size;
+}
+
+void fakeSerialInput(const char *text) {
+  fake::serialReceive(text);
+}
+
+std::string fakeSerialOutput() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  std::string out;
+  out.swap(serial.tx);
+  return out;
+}
+
+void fakeSerialEcho(bool echo) {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  serial.echo = echo;
+}
+
+uint32_t fakeSerialFlushes() {
+  SerialState &serial = serialState();
+  std::lock_guard<std::mutex> lock(serial.mutex);
+  return serial.flushes;
+}
+
+// ESP
+EspClass ESP;
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(fake::nowUs() * 240);
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart() called\n");
+  abort();
+}
+
+BaseType_t xPortGetCoreID() {
+  return current_core;
+}
@@ -0,0 +1,23 @@
+#include <Bounce2.h>
+
+void Bounce::attach(int pin) {
+  _pin = pin;
+  _stable = _unstable = digitalRead(pin);
+  _changed = false;
+  _previous = millis();
+}
+
+bool Bounce::update() {
+  _changed = false;
+  bool level = digitalRead(_pin);
+  if (level != _unstable) {
+    _previous = millis();
+    _unstable = level;
+  }
+  if (millis() - _previous >= _interval && _unstable != _stable) {
+    _previous = millis();
+    _stable = _unstable;
+    _changed = true;
+  }
+  return _changed;
+}
@@ -0,0 +1,279 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_sleep.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <driver/uart.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+namespace {
+
+const int PIN_COUNT = 40;
+
+struct SleepState {
+  uint64_t timer_us = 0;          // 0: no timer wake
+  bool gpio_wake = false;
+  int wake_levels[PIN_COUNT];     // Level that wakes each pin, -1 for none
+  bool uart_wake = false;
+  esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  FakeSleepStats stats = {};
+
+  SleepState() {
+    for (int i = 0; i < PIN_COUNT; i++) wake_levels[i] = -1;
+  }
+};
+
+SleepState &sleepState() {
+  static SleepState *state = new SleepState;
+  return *state;
+}
+
+std::atomic<uint32_t> wdt_resets{0};
+thread_local bool wdt_subscribed = false;
+std::atomic<uint64_t> wdt_last_feed{0};   // Subscribed task only
+std::atomic<uint64_t> wdt_longest_gap{0};
+std::atomic<bool> real_timer{false};
+std::atomic<size_t> largest_free_block{110000};
+uint32_t ledc_duty[2][4];
+
+bool pinWakes(const SleepState &state, int pin, int level) {
+  return state.gpio_wake && pin >= 0 && pin < PIN_COUNT && state.wake_levels[pin] == level;
+}
+
+}  // namespace
+
+esp_reset_reason_t esp_reset_reason() {
+  return ESP_RST_POWERON;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  (void)caps;
+  return 180000;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  (void)caps;
+  return largest_free_block;
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps) {
+  memset(info, 0, sizeof(*info));
+  info->total_free_bytes = heap_caps_get_free_size(caps);
+  info->largest_free_block = heap_caps_get_largest_free_block(caps);
+  info->minimum_free_bytes = ESP.getMinFreeHeap();
+}
+
+void fakeHeapLargestBlock(size_t bytes) {
+  largest_free_block = bytes;
+}
+
+// Watchdog: the fake counts feeds and measures the gaps of the subscribed
+// task, it never resets
+esp_err_t esp_task_wdt_init(uint32_t timeout_s, bool panic) {
+  (void)timeout_s;
+  (void)panic;
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t task) {
+  (void)task;
+  wdt_subscribed = true;
+  wdt_last_feed = fake::nowUs();
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t task) {
+  (void)task;
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset() {
+  wdt_resets++;
+  if (!wdt_subscribed) return ESP_ERR_NOT_FOUND;
+
+  uint64_t now = fake::nowUs();
+  uint64_t gap = now - wdt_last_feed;
+  if (gap > wdt_longest_gap) wdt_longest_gap = gap;
+  wdt_last_feed = now;
+  return ESP_OK;
+}
+
+uint32_t fakeWdtResets() {
+  return wdt_resets;
+}
+
+uint64_t fakeWdtLongestGapUs() {
+  uint64_t now = fake::nowUs();
+  uint64_t gap = now - wdt_last_feed;
+  if (gap < wdt_longest_gap) gap = wdt_longest_gap;
+  wdt_longest_gap = 0;
+  wdt_last_feed = now;
+  return gap;
+}
+
+int64_t esp_timer_get_time() {
+  if (real_timer) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  return (int64_t)fake::nowUs();
+}
+
+void fakeRealTimer(bool real) {
+  real_timer = real;
+}
+
+// Backlight PWM
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+  (void)timer_conf;
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+  ledc_duty[ledc_conf->speed_mode & 1][ledc_conf->channel & 3] = ledc_conf->duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+  ledc_duty[speed_mode & 1][channel & 3] = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  (void)speed_mode;
+  (void)channel;
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  return ledc_duty[speed_mode & 1][channel & 3];
+}
+
+// Light sleep
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if (gpio_num < 0 || gpio_num >= PIN_COUNT) return ESP_FAIL;
+  if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL) return ESP_FAIL;
+  sleepState().wake_levels[gpio_num] = intr_type == GPIO_INTR_HIGH_LEVEL ? HIGH : LOW;
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+  if (gpio_num < 0 || gpio_num >= PIN_COUNT) return ESP_FAIL;
+  sleepState().wake_levels[gpio_num] = -1;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+  sleepState().timer_us = time_in_us;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  sleepState().gpio_wake = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num) {
+  if (uart_num != 0) return ESP_FAIL;
+  sleepState().uart_wake = true;
+  return ESP_OK;
+}
+
+// The fake loses one byte per UART wake-up whatever the threshold
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold) {
+  if (uart_num != UART_NUM_0 || wakeup_threshold < 3 || wakeup_threshold > 0x3ff) return ESP_FAIL;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  SleepState &state = sleepState();
+  if (source == ESP_SLEEP_WAKEUP_TIMER || source == ESP_SLEEP_WAKEUP_ALL) state.timer_us = 0;
+  if (source == ESP_SLEEP_WAKEUP_GPIO || source == ESP_SLEEP_WAKEUP_ALL) state.gpio_wake = false;
+  if (source == ESP_SLEEP_WAKEUP_UART || source == ESP_SLEEP_WAKEUP_ALL) state.uart_wake = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option) {
+  (void)domain;
+  (void)option;
+  return ESP_OK;
+}
+
+// Moves the clock to the wake-up. Scheduled inputs inside the sleep still
+// happen; a pin wake source or UART activity (with UART wake enabled) ends
+// the sleep early. The UART is stopped meanwhile: received bytes are lost,
+// with UART wake only the one that woke the chip, and bytes still in the TX
+// FIFO go out garbled.
+esp_err_t esp_light_sleep_start() {
+  SleepState &state = sleepState();
+  uint64_t start = fake::nowUs();
+  uint64_t wake = state.timer_us != 0 ? start + state.timer_us : UINT64_MAX;
+
+  if (wake == UINT64_MAX && !state.gpio_wake && !state.uart_wake) return ESP_FAIL;  // Would never wake
+
+  state.stats.sleeps++;
+  state.stats.tx_garbled_bytes += fake::serialTxPending();
+  state.cause = ESP_SLEEP_WAKEUP_TIMER;
+
+  // A level wake source that is already active wakes right away
+  for (int pin = 0; pin < PIN_COUNT; pin++) {
+    if (pinWakes(state, pin, fake::inputLevel(pin))) {
+      state.cause = ESP_SLEEP_WAKEUP_GPIO;
+      wake = start;
+    }
+  }
+
+  uint64_t at;
+  fake::Event event;
+  while (wake > start && fake::takeEvent(wake, &at, &event)) {
+    fake::advanceTo(at);
+
+    if (event.kind == fake::EVENT_SERIAL) {
+      if (!state.uart_wake) {
+        state.stats.lost_serial_bytes += event.text.size();
+        continue;
+      }
+      state.stats.lost_serial_bytes++;
+      event.text.erase(0, 1);
+      fake::applyEvent(event);
+      state.cause = ESP_SLEEP_WAKEUP_UART;
+      wake = at;
+      break;
+    }
+
+    fake::applyEvent(event);
+    if (event.kind == fake::EVENT_PIN && pinWakes(state, event.pin, event.level)) {
+      state.cause = ESP_SLEEP_WAKEUP_GPIO;
+      wake = at;
+      break;
+    }
+  }
+
+  if (wake == UINT64_MAX) return ESP_FAIL;  // Only pin wake-ups and none came
+  fake::advanceTo(wake);
+
+  state.stats.slept_us += wake - start;
+  if (state.cause == ESP_SLEEP_WAKEUP_GPIO) state.stats.gpio_wakes++;
+  else if (state.cause == ESP_SLEEP_WAKEUP_UART) state.stats.uart_wakes++;
+  else state.stats.timer_wakes++;
+  return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return sleepState().cause;
+}
+
+const FakeSleepStats &fakeSleepStats() {
+  return sleepState().stats;
+}
+
+void fakeResetSleepStats() {
+  sleepState().stats = FakeSleepStats();
+}
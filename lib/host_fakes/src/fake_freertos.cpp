@@ -0,0 +1,324 @@
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <thread>
+#include <vector>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+namespace {
+
+// Thrown by vTaskDelete(NULL) to unwind the task thread
+struct TaskExit {};
+
+// A blocked thread; woken once something it may wait for has changed
+struct Waiter {
+  uint64_t deadline;  // UINT64_MAX: no timeout
+  bool woken;
+};
+
+struct Scheduler {
+  std::condition_variable changed;
+  std::list<Waiter *> waiters;   // Blocked task threads
+  int runnable = 0;              // Task threads that are not blocked
+};
+
+Scheduler &scheduler() {
+  static Scheduler *state = new Scheduler;
+  return *state;
+}
+
+std::atomic<bool> task_create_fails{false};
+
+// The main thread stands in for Arduino's loopTask
+char loop_task_handle;
+thread_local TaskHandle_t current_task = &loop_task_handle;
+
+void wake(Waiter *waiter) {
+  if (waiter->woken) return;
+  waiter->woken = true;
+  scheduler().runnable++;
+}
+
+void wakeDue(uint64_t now) {
+  for (Waiter *waiter : scheduler().waiters) {
+    if (waiter->deadline <= now) wake(waiter);
+  }
+  scheduler().changed.notify_all();
+}
+
+uint64_t earliestDeadline() {
+  uint64_t earliest = UINT64_MAX;
+  for (Waiter *waiter : scheduler().waiters) {
+    if (!waiter->woken && waiter->deadline < earliest) earliest = waiter->deadline;
+  }
+  return earliest;
+}
+
+void waitIdle(std::unique_lock<std::mutex> &lock) {
+  scheduler().changed.wait(lock, [] { return scheduler().runnable == 0; });
+}
+
+}  // namespace
+
+struct FakeSemaphore {
+  bool given;
+};
+
+struct FakeQueue {
+  size_t length;
+  size_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+namespace fake {
+
+std::mutex &rtosMutex() {
+  static std::mutex *mutex = new std::mutex;
+  return *mutex;
+}
+
+void wakeAll() {
+  for (Waiter *waiter : scheduler().waiters) wake(waiter);
+  scheduler().changed.notify_all();
+}
+
+void taskStarted() {
+  std::lock_guard<std::mutex> lock(rtosMutex());
+  scheduler().runnable++;
+}
+
+void taskExited() {
+  std::lock_guard<std::mutex> lock(rtosMutex());
+  scheduler().runnable--;
+  scheduler().changed.notify_all();
+}
+
+void advanceTo(uint64_t target) {
+  if (onTask()) {
+    blockUntil(target, [] { return false; });
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(rtosMutex());
+  while (true) {
+    waitIdle(lock);
+
+    uint64_t next = target;
+    uint64_t deadline = earliestDeadline();
+    if (deadline < next) next = deadline;
+    uint64_t event_at;
+    if (nextEventAt(&event_at) && event_at < next) next = event_at;
+
+    storeNow(next);
+    wakeDue(nowUs());
+
+    lock.unlock();
+    uint64_t at;
+    Event event;
+    while (takeEvent(nowUs(), &at, &event)) applyEvent(event);
+    lock.lock();
+
+    if (nowUs() >= target) {
+      waitIdle(lock);
+      return;
+    }
+  }
+}
+
+bool blockFor(uint32_t ticks, const std::function<bool()> &attempt) {
+  if (ticks == 0) {
+    std::lock_guard<std::mutex> lock(rtosMutex());
+    if (!attempt()) return false;
+    wakeAll();
+    return true;
+  }
+  return blockUntil(ticks == portMAX_DELAY ? UINT64_MAX : nowUs() + (uint64_t)ticks * 1000, attempt);
+}
+
+bool blockUntil(uint64_t deadline, const std::function<bool()> &attempt) {
+  std::unique_lock<std::mutex> lock(rtosMutex());
+  if (attempt()) {
+    wakeAll();
+    return true;
+  }
+  if (nowUs() >= deadline) return false;
+
+  if (onTask()) {
+    Waiter waiter = {deadline, false};
+    while (true) {
+      waiter.woken = false;
+      scheduler().waiters.push_back(&waiter);
+      scheduler().runnable--;
+      scheduler().changed.notify_all();
+      scheduler().changed.wait(lock, [&] { return waiter.woken; });
+      scheduler().waiters.remove(&waiter);
+
+      if (attempt()) {
+        wakeAll();
+        return true;
+      }
+      if (nowUs() >= deadline) return false;
+    }
+  }
+
+  // Main thread: wait for the tasks to settle, then move the clock to the
+  // next thing that can happen
+  while (true) {
+    bool done = false;
+    scheduler().changed.wait(lock, [&] {
+      done = attempt();
+      return done || scheduler().runnable == 0;
+    });
+    if (done) {
+      wakeAll();
+      return true;
+    }
+    if (nowUs() >= deadline) return false;
+
+    uint64_t next = deadline;
+    uint64_t task_deadline = earliestDeadline();
+    if (task_deadline < next) next = task_deadline;
+    uint64_t event_at;
+    if (nextEventAt(&event_at) && event_at < next) next = event_at;
+    if (next == UINT64_MAX) {
+      fprintf(stderr, "host fakes: main thread blocked forever\n");
+      return false;
+    }
+
+    lock.unlock();
+    advanceTo(next);
+    lock.lock();
+  }
+}
+
+}  // namespace fake
+
+void fakeTaskCreateFails(bool fails) {
+  task_create_fails = fails;
+}
+
+// Tasks
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+  (void)name;
+  (void)stack_depth;
+  (void)priority;
+  if (task_create_fails) return pdFAIL;
+
+  fake::taskStarted();
+  std::thread([code, param, core] {
+    fake::markTask(core);
+    current_task = (TaskHandle_t)code;
+    try {
+      code(param);
+    } catch (const TaskExit &) {
+    }
+    fake::taskExited();
+  }).detach();
+
+  if (created != NULL) *created = (TaskHandle_t)code;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == NULL && fake::onTask()) throw TaskExit();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (!fake::onTask()) {
+    delay(ticks);
+    return;
+  }
+  fake::blockFor(ticks, [] { return false; });
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(fake::nowUs() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  (void)task;
+  return 4096;
+}
+
+// Critical sections spin like the ESP32 port's portMUX
+void vPortEnterCritical(portMUX_TYPE *mux) {
+  while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) {
+    std::this_thread::yield();
+  }
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+  __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+// Semaphores
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return new FakeSemaphore{false};
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  std::lock_guard<std::mutex> lock(fake::rtosMutex());
+  if (semaphore->given) return pdFALSE;
+  semaphore->given = true;
+  fake::wakeAll();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  return fake::blockFor(ticks, [semaphore] {
+    if (!semaphore->given) return false;
+    semaphore->given = false;
+    return true;
+  }) ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+// Queues
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  return new FakeQueue{length, item_size, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  return fake::blockFor(ticks, [queue, item] {
+    if (queue->items.size() >= queue->length) return false;
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    return true;
+  }) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  return fake::blockFor(ticks, [queue, item] {
+    if (queue->items.empty()) return false;
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    return true;
+  }) ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(fake::rtosMutex());
+  return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(fake::rtosMutex());
+  return queue->length - queue->items.size();
+}
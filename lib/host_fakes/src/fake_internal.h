@@ -0,0 +1,62 @@
+#pragma once
+
+// Shared state of the host fakes, not for tests (see host_fakes.h)
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace fake {
+
+enum EventKind {
+  EVENT_PIN,
+  EVENT_SERIAL,
+  EVENT_TAP,
+  EVENT_REMOVE
+};
+
+struct Event {
+  EventKind kind;
+  uint8_t pin;          // Input pin or reader chip select
+  int level;
+  std::string text;     // Serial bytes
+  uint8_t uid[10];
+  uint8_t uid_size;
+};
+
+// Scheduler. Task threads run freely until they block; the clock only moves
+// on the main thread, and only once every task thread is blocked, so a test
+// sees the same interleaving of tasks and time on every run.
+std::mutex &rtosMutex();
+
+uint64_t nowUs();
+void storeNow(uint64_t us);       // Clock write for the scheduler, rtosMutex held
+void advanceTo(uint64_t us);      // Steps through task wake-ups and scheduled events on the way
+bool onTask();                    // Caller runs in a task created by xTaskCreatePinnedToCore()
+void markTask(int core);
+void taskStarted();
+void taskExited();
+
+// Blocks until attempt() succeeds or the ticks (ms) run out. attempt() runs
+// with rtosMutex held and performs the operation (take, send, ...) when it
+// can. ticks of portMAX_DELAY wait forever.
+bool blockFor(uint32_t ticks, const std::function<bool()> &attempt);
+bool blockUntil(uint64_t deadline_us, const std::function<bool()> &attempt);  // UINT64_MAX: forever
+
+// rtosMutex held: blocked threads re-check their condition
+void wakeAll();
+
+// Next scheduled event due at or before until_us, removed from the schedule
+bool takeEvent(uint64_t until_us, uint64_t *at, Event *out);
+bool nextEventAt(uint64_t *at);
+void applyEvent(const Event &event);
+
+// Pins and peripherals driven by events
+int inputLevel(uint8_t pin);
+void serialReceive(const std::string &text);
+uint32_t serialTxPending();       // Bytes still leaving the UART
+void readerTap(uint8_t ss_pin, const uint8_t *uid, uint8_t size);
+void readerRemove(uint8_t ss_pin);
+
+}  // namespace fake
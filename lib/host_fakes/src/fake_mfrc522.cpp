@@ -0,0 +1,131 @@
+#include <MFRC522.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+namespace {
+
+struct Field {
+  bool inited = false;
+  bool present = false;
+  bool halted = false;     // Answered a read, silent until it leaves the field
+  uint8_t uid[10];
+  uint8_t uid_size = 0;
+  uint32_t polls = 0;
+};
+
+struct ReaderState {
+  std::mutex mutex;
+  std::map<uint8_t, Field> fields;
+};
+
+ReaderState &readerState() {
+  static ReaderState *state = new ReaderState;
+  return *state;
+}
+
+std::atomic<bool> timing{false};
+
+// MFRC522 transaction times, charged with fakeReaderTiming(true)
+const uint32_t REQA_TIMEOUT_US = 25000;  // Timer set by PCD_Init(): TPrescaler 0xA9, TReload 1000
+const uint32_t REQA_ANSWER_US = 1000;
+const uint32_t SELECT_US = 3000;         // Anticollision and select of a single-size UID
+
+}  // namespace
+
+namespace fake {
+
+void readerTap(uint8_t ss_pin, const uint8_t *uid, uint8_t size) {
+  ReaderState &state = readerState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  Field &field = state.fields[ss_pin];
+  if (size > sizeof(field.uid)) size = sizeof(field.uid);
+  memcpy(field.uid, uid, size);
+  field.uid_size = size;
+  field.present = true;
+  field.halted = false;
+}
+
+void readerRemove(uint8_t ss_pin) {
+  ReaderState &state = readerState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  Field &field = state.fields[ss_pin];
+  field.present = false;
+  field.halted = false;
+}
+
+}  // namespace fake
+
+MFRC522::MFRC522(byte chipSelectPin, byte resetPowerDownPin)
+  : _chipSelectPin(chipSelectPin), _resetPowerDownPin(resetPowerDownPin) {
+  memset(&uid, 0, sizeof(uid));
+}
+
+void MFRC522::PCD_Init() {
+  ReaderState &state = readerState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.fields[_chipSelectPin].inited = true;
+}
+
+void MFRC522::PCD_Init(byte chipSelectPin, byte resetPowerDownPin) {
+  _chipSelectPin = chipSelectPin;
+  _resetPowerDownPin = resetPowerDownPin;
+  PCD_Init();
+}
+
+bool MFRC522::PICC_IsNewCardPresent() {
+  bool answered;
+  {
+    ReaderState &state = readerState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    Field &field = state.fields[_chipSelectPin];
+    field.polls++;
+    answered = field.inited && field.present && !field.halted;
+  }
+  if (timing) delayMicroseconds(answered ? REQA_ANSWER_US : REQA_TIMEOUT_US);
+  return answered;
+}
+
+bool MFRC522::PICC_ReadCardSerial() {
+  {
+    ReaderState &state = readerState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    Field &field = state.fields[_chipSelectPin];
+    if (!field.inited || !field.present || field.halted) return false;
+    uid.size = field.uid_size;
+    memcpy(uid.uidByte, field.uid, field.uid_size);
+    uid.sak = 0x08;
+  }
+  if (timing) delayMicroseconds(SELECT_US);
+  return true;
+}
+
+MFRC522::StatusCode MFRC522::PICC_HaltA() {
+  ReaderState &state = readerState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  Field &field = state.fields[_chipSelectPin];
+  if (field.present) field.halted = true;
+  return STATUS_OK;
+}
+
+void fakeCardTap(uint8_t ss_pin, const uint8_t *uid, uint8_t size) {
+  fake::readerTap(ss_pin, uid, size);
+}
+
+void fakeCardRemove(uint8_t ss_pin) {
+  fake::readerRemove(ss_pin);
+}
+
+void fakeReaderTiming(bool on) {
+  timing = on;
+}
+
+uint32_t fakeReaderPolls(uint8_t ss_pin) {
+  ReaderState &state = readerState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.fields[ss_pin].polls;
+}
@@ -0,0 +1,282 @@
+#include <SD.h>
+#include <SPI.h>
+#include <Wire.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+namespace {
+
+struct SdState {
+  std::mutex mutex;
+  std::string root;
+  bool mount_fails = false;
+  unsigned long mount_delay_ms = 0;
+};
+
+SdState &sdState() {
+  static SdState *state = new SdState;
+  return *state;
+}
+
+// Transfer time: command, response and data token per bulk transfer, then
+// the bytes at the SPI clock given to SD.begin()
+const uint32_t SD_COMMAND_US = 150;
+std::atomic<uint32_t> sd_frequency{4000000};
+
+void chargeTransfer(size_t bytes) {
+  delayMicroseconds(SD_COMMAND_US + (uint32_t)((uint64_t)bytes * 8 * 1000000 / sd_frequency));
+}
+
+const int BUS_COUNT = 4;
+const int CORE_COUNT = 2;
+std::atomic<uint32_t> spi_starts[BUS_COUNT][CORE_COUNT];
+std::map<std::string, uint32_t> sd_opens[CORE_COUNT];  // Under SdState::mutex
+
+std::string root() {
+  SdState &state = sdState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.root.empty()) {
+    char dir[] = "/tmp/host_sd_XXXXXX";
+    if (mkdtemp(dir) != NULL) state.root = dir;
+  }
+  return state.root;
+}
+
+std::string hostPath(const char *path) {
+  std::string full = root();
+  if (path[0] != '/') full += '/';
+  return full + path;
+}
+
+}  // namespace
+
+namespace fs {
+
+struct FileHandle {
+  FILE *file;
+  std::string name;
+
+  ~FileHandle() {
+    if (file != NULL) fclose(file);
+  }
+};
+
+File::operator bool() const {
+  return _handle && _handle->file != NULL;
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!*this) return 0;
+  chargeTransfer(size);
+  return fwrite(buffer, 1, size, _handle->file);
+}
+
+int File::available() {
+  if (!*this) return 0;
+  long at = ftell(_handle->file);
+  return at < 0 ? 0 : (int)(size() - (size_t)at);
+}
+
+int File::read() {
+  if (!*this) return -1;
+  return fgetc(_handle->file);
+}
+
+int File::peek() {
+  if (!*this) return -1;
+  int c = fgetc(_handle->file);
+  if (c != EOF) ungetc(c, _handle->file);
+  return c;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!*this) return 0;
+  chargeTransfer(size);
+  return fread(buffer, 1, size, _handle->file);
+}
+
+void File::flush() {
+  if (*this) fflush(_handle->file);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this) return false;
+  int whence = mode == SeekCur ? SEEK_CUR : mode == SeekEnd ? SEEK_END : SEEK_SET;
+  return fseek(_handle->file, pos, whence) == 0;
+}
+
+size_t File::position() const {
+  if (!*this) return 0;
+  long at = ftell(_handle->file);
+  return at < 0 ? 0 : (size_t)at;
+}
+
+size_t File::size() const {
+  if (!*this) return 0;
+  fflush(_handle->file);
+  struct stat st;
+  if (fstat(fileno(_handle->file), &st) != 0) return 0;
+  return (size_t)st.st_size;
+}
+
+void File::close() {
+  if (_handle && _handle->file != NULL) {
+    fclose(_handle->file);
+    _handle->file = NULL;
+  }
+  _handle.reset();
+}
+
+const char *File::name() const {
+  return _handle ? _handle->name.c_str() : "";
+}
+
+File FS::open(const char *path, const char *mode, const bool create) {
+  (void)create;
+  if (!_mounted) return File();
+
+  const char *host_mode = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "rb";
+  FILE *file = fopen(hostPath(path).c_str(), host_mode);
+  if (file == NULL) return File();
+
+  int core = xPortGetCoreID();
+  if (core >= 0 && core < CORE_COUNT) {
+    std::lock_guard<std::mutex> lock(sdState().mutex);
+    sd_opens[core][path]++;
+  }
+
+  std::shared_ptr<FileHandle> handle(new FileHandle);
+  handle->file = file;
+  handle->name = path;
+  return File(handle);
+}
+
+bool FS::exists(const char *path) {
+  if (!_mounted) return false;
+  return access(hostPath(path).c_str(), F_OK) == 0;
+}
+
+bool FS::remove(const char *path) {
+  if (!_mounted) return false;
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *path_from, const char *path_to) {
+  if (!_mounted) return false;
+  return ::rename(hostPath(path_from).c_str(), hostPath(path_to).c_str()) == 0;
+}
+
+}  // namespace fs
+
+SDFS SD;
+
+bool SDFS::begin(uint8_t ssPin, SPIClass &spi, uint32_t frequency, const char *mountpoint,
+                 uint8_t max_files, bool format_if_empty) {
+  (void)ssPin;
+  (void)mountpoint;
+  (void)max_files;
+  (void)format_if_empty;
+  spi.begin();
+  sd_frequency = frequency;
+
+  unsigned long delay_ms;
+  bool fails;
+  {
+    SdState &state = sdState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    delay_ms = state.mount_delay_ms;
+    fails = state.mount_fails;
+  }
+  if (delay_ms != 0) delay(delay_ms);
+
+  _mounted = !fails && !root().empty();
+  return _mounted;
+}
+
+// SPI
+SPIClass SPI(VSPI);
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss) {
+  (void)sck;
+  (void)miso;
+  (void)mosi;
+  (void)ss;
+  if (_started) return;
+  _started = true;
+  int core = xPortGetCoreID();
+  if (_bus < BUS_COUNT && core >= 0 && core < CORE_COUNT) spi_starts[_bus][core]++;
+}
+
+uint32_t fakeSpiStarts(uint8_t bus, int core) {
+  if (bus >= BUS_COUNT || core < 0 || core >= CORE_COUNT) return 0;
+  return spi_starts[bus][core];
+}
+
+uint32_t fakeSdOpens(const char *path, int core) {
+  if (core < 0 || core >= CORE_COUNT) return 0;
+  std::lock_guard<std::mutex> lock(sdState().mutex);
+  auto found = sd_opens[core].find(path);
+  return found == sd_opens[core].end() ? 0 : found->second;
+}
+
+TwoWire Wire;
+
+// SD card contents
+const char *fakeSdRoot(const char *dir) {
+  SdState &state = sdState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (dir != NULL) {
+    state.root = dir;
+  } else {
+    char fresh[] = "/tmp/host_sd_XXXXXX";
+    state.root = mkdtemp(fresh) != NULL ? fresh : "";
+  }
+  return state.root.c_str();
+}
+
+std::string fakeSdPath(const char *path) {
+  return hostPath(path);
+}
+
+void fakeSdWrite(const char *path, const std::string &content) {
+  FILE *file = fopen(hostPath(path).c_str(), "wb");
+  if (file == NULL) return;
+  fwrite(content.data(), 1, content.size(), file);
+  fclose(file);
+}
+
+std::string fakeSdRead(const char *path) {
+  std::string content;
+  FILE *file = fopen(hostPath(path).c_str(), "rb");
+  if (file == NULL) return content;
+  char buffer[512];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) content.append(buffer, n);
+  fclose(file);
+  return content;
+}
+
+void fakeSdMountFails(bool fails) {
+  SdState &state = sdState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.mount_fails = fails;
+}
+
+void fakeSdMountDelay(unsigned long ms) {
+  SdState &state = sdState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.mount_delay_ms = ms;
+}
@@ -0,0 +1,343 @@
+#include <TFT_eSPI.h>
+
+#include <mutex>
+#include <vector>
+
+#include "host_fakes.h"
+
+#if __has_include("glcdfont.c")
+#include "glcdfont.c"
+#define FAKE_HAS_FONT 1
+#else
+#define FAKE_HAS_FONT 0
+#endif
+
+namespace {
+
+struct Screen {
+  std::mutex mutex;
+  int32_t width = TFT_WIDTH;
+  int32_t height = TFT_HEIGHT;
+  std::vector<uint16_t> pixels = std::vector<uint16_t>(TFT_WIDTH * TFT_HEIGHT, 0);
+  std::vector<FakeGlyph> glyphs;
+};
+
+Screen &screen() {
+  static Screen *state = new Screen;
+  return *state;
+}
+
+// Column bits of a GLCD glyph, a filled box when the font is not installed
+uint8_t glyphColumn(uint16_t c, int column) {
+  if (column >= 5) return 0;
+#if FAKE_HAS_FONT
+  return pgm_read_byte(font + (c & 0xff) * 5 + column);
+#else
+  return c == ' ' ? 0 : 0x7f;
+#endif
+}
+
+// PNG encoding with stored (uncompressed) deflate blocks
+uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+  }
+  return ~crc;
+}
+
+void putBE32(std::string &out, uint32_t v) {
+  out += (char)(v >> 24);
+  out += (char)(v >> 16);
+  out += (char)(v >> 8);
+  out += (char)v;
+}
+
+void putChunk(FILE *file, const char *type, const std::string &data) {
+  std::string chunk;
+  putBE32(chunk, data.size());
+  chunk.append(type, 4);
+  chunk += data;
+  putBE32(chunk, crc32(0, (const uint8_t *)chunk.data() + 4, chunk.size() - 4));
+  fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+}  // namespace
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h) : _width(w), _height(h), _spi(VSPI) {}
+
+void TFT_eSPI::init(uint8_t tc) {
+  (void)tc;
+  _spi.begin();
+  setRotation(0);
+}
+
+void TFT_eSPI::setRotation(uint8_t r) {
+  _rotation = r & 3;
+  _width = _rotation & 1 ? TFT_HEIGHT : TFT_WIDTH;
+  _height = _rotation & 1 ? TFT_WIDTH : TFT_HEIGHT;
+
+  Screen &s = screen();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.width = _width;
+  s.height = _height;
+  s.pixels.assign(_width * _height, 0);
+}
+
+void TFT_eSPI::setPixel(int32_t x, int32_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+  Screen &s = screen();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.pixels[y * s.width + x] = color;
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color) {
+  setPixel(x, y, color);
+}
+
+void TFT_eSPI::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) {
+  for (int32_t i = 0; i < w; i++) setPixel(x + i, y, color);
+}
+
+void TFT_eSPI::drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) {
+  for (int32_t i = 0; i < h; i++) setPixel(x, y + i, color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  for (int32_t j = 0; j < h; j++) {
+    for (int32_t i = 0; i < w; i++) setPixel(x + i, y + j, color);
+  }
+}
+
+// GLCD glyph: 5 columns of 7 rows plus a blank column, scaled by size. The
+// background is left alone when it matches the foreground.
+void TFT_eSPI::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size) {
+  {
+    Screen &s = screen();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    FakeGlyph glyph = {x, y, c};
+    s.glyphs.push_back(glyph);
+  }
+  for (int i = 0; i < 6; i++) {
+    uint8_t line = glyphColumn(c, i);
+    for (int j = 0; j < 8; j++, line >>= 1) {
+      if (!(line & 1) && bg == color) continue;
+      uint16_t pixel = line & 1 ? color : bg;
+      for (int dy = 0; dy < size; dy++) {
+        for (int dx = 0; dx < size; dx++) setPixel(x + i * size + dx, y + j * size + dy, pixel);
+      }
+    }
+  }
+}
+
+int16_t TFT_eSPI::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font) {
+  (void)font;
+  drawChar(x, y, uniCode, textcolor, textbgcolor, textsize);
+  return 6 * textsize;
+}
+
+size_t TFT_eSPI::write(uint8_t c) {
+  if (c == '\r') return 1;
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += 8 * textsize;
+    return 1;
+  }
+  if (textwrapX && cursor_x + 6 * textsize > _width) {
+    cursor_x = 0;
+    cursor_y += 8 * textsize;
+  }
+  drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
+  cursor_x += 6 * textsize;
+  return 1;
+}
+
+void TFT_eSPI::fillScreen(uint32_t color) {
+  fillRect(0, 0, _width, _height, color);
+}
+
+void TFT_eSPI::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y + 1, h - 2, color);
+  drawFastVLine(x + w - 1, y + 1, h - 2, color);
+}
+
+void TFT_eSPI::drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color) {
+  drawFastHLine(x + r, y, w - r - r, color);
+  drawFastHLine(x + r, y + h - 1, w - r - r, color);
+  drawFastVLine(x, y + r, h - r - r, color);
+  drawFastVLine(x + w - 1, y + r, h - r - r, color);
+  drawCircleHelper(x + r, y + r, r, 1, color);
+  drawCircleHelper(x + w - r - 1, y + r, r, 2, color);
+  drawCircleHelper(x + w - r - 1, y + h - r - 1, r, 4, color);
+  drawCircleHelper(x + r, y + h - r - 1, r, 8, color);
+}
+
+void TFT_eSPI::fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color) {
+  fillRect(x, y + r, w, h - r - r, color);
+  fillCircleHelper(x + r, y + h - r - 1, r, 1, w - r - r - 1, color);
+  fillCircleHelper(x + r, y + r, r, 2, w - r - r - 1, color);
+}
+
+void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color) {
+  int32_t x = 0;
+  int32_t dx = 1;
+  int32_t dy = r + r;
+  int32_t p = -(r >> 1);
+
+  drawFastHLine(x0 - r, y0, dy + 1, color);
+  while (x < r) {
+    if (p >= 0) {
+      drawFastHLine(x0 - x, y0 + r, 2 * x + 1, color);
+      drawFastHLine(x0 - x, y0 - r, 2 * x + 1, color);
+      dy -= 2;
+      p -= dy;
+      r--;
+    }
+    dx += 2;
+    p += dx;
+    x++;
+    drawFastHLine(x0 - r, y0 + x, 2 * r + 1, color);
+    drawFastHLine(x0 - r, y0 - x, 2 * r + 1, color);
+  }
+}
+
+void TFT_eSPI::drawCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t cornername, uint32_t color) {
+  int32_t f = 1 - r;
+  int32_t ddF_x = 1;
+  int32_t ddF_y = -2 * r;
+  int32_t x = 0;
+
+  while (x < r) {
+    if (f >= 0) {
+      r--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    if (cornername & 0x4) {
+      drawPixel(x0 + x, y0 + r, color);
+      drawPixel(x0 + r, y0 + x, color);
+    }
+    if (cornername & 0x2) {
+      drawPixel(x0 + x, y0 - r, color);
+      drawPixel(x0 + r, y0 - x, color);
+    }
+    if (cornername & 0x8) {
+      drawPixel(x0 - r, y0 + x, color);
+      drawPixel(x0 - x, y0 + r, color);
+    }
+    if (cornername & 0x1) {
+      drawPixel(x0 - r, y0 - x, color);
+      drawPixel(x0 - x, y0 - r, color);
+    }
+  }
+}
+
+void TFT_eSPI::fillCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t cornername, int32_t delta, uint32_t color) {
+  int32_t f = 1 - r;
+  int32_t ddF_x = 1;
+  int32_t ddF_y = -r - r;
+  int32_t y = 0;
+
+  delta++;
+  while (y < r) {
+    if (f >= 0) {
+      if (cornername & 0x1) drawFastHLine(x0 - y, y0 + r, y + y + delta, color);
+      if (cornername & 0x2) drawFastHLine(x0 - y, y0 - r, y + y + delta, color);
+      r--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    y++;
+    ddF_x += 2;
+    f += ddF_x;
+    if (cornername & 0x1) drawFastHLine(x0 - r, y0 + y, r + r + delta, color);
+    if (cornername & 0x2) drawFastHLine(x0 - r, y0 - y, r + r + delta, color);
+  }
+}
+
+void TFT_eSPI::setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h) {
+  _win_x = x;
+  _win_y = y;
+  _win_w = w;
+  _win_h = h;
+  _win_pos = 0;
+}
+
+void TFT_eSPI::pushBlock(uint16_t color, uint32_t len) {
+  while (len-- && _win_w > 0 && _win_pos < (uint32_t)(_win_w * _win_h)) {
+    setPixel(_win_x + _win_pos % _win_w, _win_y + _win_pos / _win_w, color);
+    _win_pos++;
+  }
+}
+
+uint16_t fakeTftPixel(int32_t x, int32_t y) {
+  Screen &s = screen();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (x < 0 || y < 0 || x >= s.width || y >= s.height) return 0;
+  return s.pixels[y * s.width + x];
+}
+
+std::vector<FakeGlyph> fakeTftGlyphs() {
+  Screen &s = screen();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::vector<FakeGlyph> glyphs;
+  glyphs.swap(s.glyphs);
+  return glyphs;
+}
+
+bool fakeTftSavePng(const char *path) {
+  std::string raw;
+  int32_t width, height;
+  {
+    Screen &s = screen();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    width = s.width;
+    height = s.height;
+    raw.reserve((width * 3 + 1) * height);
+    for (int32_t y = 0; y < height; y++) {
+      raw += '\0';  // No filter
+      for (int32_t x = 0; x < width; x++) {
+        uint16_t c = s.pixels[y * width + x];
+        raw += (char)(((c >> 11) & 0x1f) * 255 / 31);
+        raw += (char)(((c >> 5) & 0x3f) * 255 / 63);
+        raw += (char)((c & 0x1f) * 255 / 31);
+      }
+    }
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) return false;
+  fwrite("\x89PNG\r\n\x1a\n", 1, 8, file);
+
+  std::string header;
+  putBE32(header, width);
+  putBE32(header, height);
+  header += std::string("\x08\x02\x00\x00\x00", 5);  // 8-bit RGB
+  putChunk(file, "IHDR", header);
+
+  std::string zlib("\x78\x01", 2);
+  uint32_t a = 1, b = 0;
+  for (size_t at = 0; at < raw.size(); at += 65535) {
+    size_t len = raw.size() - at < 65535 ? raw.size() - at : 65535;
+    zlib += (char)(at + len == raw.size() ? 1 : 0);
+    zlib += (char)(len & 0xff);
+    zlib += (char)(len >> 8);
+    zlib += (char)(~len & 0xff);
+    zlib += (char)((~len >> 8) & 0xff);
+    zlib.append(raw, at, len);
+  }
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + (uint8_t)raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  putBE32(zlib, (b << 16) | a);
+  putChunk(file, "IDAT", zlib);
+  putChunk(file, "IEND", "");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,162 @@
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+#include <mutex>
+
+#include "fake_internal.h"
+#include "host_fakes.h"
+
+namespace {
+
+// PubSubClient's fixed header: packet type, up to 4 length bytes, topic length
+const size_t MQTT_HEADER_BYTES = 7;
+
+// Publish time: one write through lwIP and the WiFi driver, then the bytes at
+// what a busy 2.4 GHz channel carries
+const uint32_t MQTT_PUBLISH_US = 1500;
+const uint32_t MQTT_LINK_BYTES_PER_S = 125000;
+
+struct NetState {
+  std::mutex mutex;
+  bool wifi_up = false;
+  bool broker_up = false;
+  uint32_t session = 1;          // Changes whenever the broker or the link goes down
+  uint32_t connects = 0;
+  std::vector<FakeMqttMessage> messages;
+};
+
+NetState &netState() {
+  static NetState *state = new NetState;
+  return *state;
+}
+
+}  // namespace
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  (void)mode;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password) {
+  (void)ssid;
+  (void)password;
+  return status();
+}
+
+wl_status_t WiFiClass::status() {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.wifi_up ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::setAutoReconnect(bool reconnect) {
+  (void)reconnect;
+  return true;
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+  const uint8_t fixed[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+  memcpy(mac, fixed, sizeof(fixed));
+  return mac;
+}
+
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char *server1,
+                const char *server2, const char *server3) {
+  (void)gmt_offset_sec;
+  (void)daylight_offset_sec;
+  (void)server1;
+  (void)server2;
+  (void)server3;
+}
+
+PubSubClient::PubSubClient(Client &client) : _buffer_size(256), _connected(false), _session(0) {
+  (void)client;
+}
+
+PubSubClient &PubSubClient::setServer(const char *domain, uint16_t port) {
+  (void)domain;
+  (void)port;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  _buffer_size = size;
+  return true;
+}
+
+PubSubClient &PubSubClient::setSocketTimeout(uint16_t timeout) {
+  (void)timeout;
+  return *this;
+}
+
+bool PubSubClient::connect(const char *id) {
+  (void)id;
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  _connected = state.wifi_up && state.broker_up;
+  _session = state.session;
+  if (_connected) state.connects++;
+  return _connected;
+}
+
+void PubSubClient::disconnect() {
+  _connected = false;
+}
+
+bool PubSubClient::connected() {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (_session != state.session) _connected = false;
+  return _connected;
+}
+
+bool PubSubClient::loop() {
+  return connected();
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length) {
+  if (!connected()) return false;
+  if (MQTT_HEADER_BYTES + strlen(topic) + length > _buffer_size) return false;
+
+  delayMicroseconds(MQTT_PUBLISH_US + (uint32_t)((uint64_t)length * 1000000 / MQTT_LINK_BYTES_PER_S));
+
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.messages.push_back({topic, std::string((const char *)payload, length)});
+  return true;
+}
+
+int PubSubClient::state() {
+  return connected() ? MQTT_CONNECTED : MQTT_DISCONNECTED;
+}
+
+// WiFi and broker controls
+void fakeWifiUp(bool up) {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.wifi_up && !up) state.session++;
+  state.wifi_up = up;
+}
+
+void fakeMqttBrokerUp(bool up) {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.broker_up && !up) state.session++;
+  state.broker_up = up;
+}
+
+std::vector<FakeMqttMessage> fakeMqttMessages() {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  std::vector<FakeMqttMessage> messages;
+  messages.swap(state.messages);
+  return messages;
+}
+
+uint32_t fakeMqttConnects() {
+  NetState &state = netState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.connects;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Test controls for the host fakes. The firmware sees a manual clock, input
+// pins, a Serial port, an SD card backed by a host directory, RFID readers
+// addressed by chip select pin and a framebuffer behind TFT_eSPI.
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// Clock: millis(), micros(), esp_timer_get_time() and time() only move when
+// a test (or delay(), or light sleep) advances them
+void fakeAdvance(unsigned long ms);
+uint64_t fakeNowUs();
+void fakeSetEpoch(time_t epoch);  // Wall clock from now on, 0 for unset (time() counts uptime, as without NTP)
+void fakeRealTimer(bool real);    // esp_timer_get_time() on the host's monotonic clock, for benchmarks
+
+// Heap: fixed numbers, only the largest free block can be changed
+void fakeHeapLargestBlock(size_t bytes);  // 110000 at start, a no-PSRAM ESP32 after boot
+
+// Pins
+void fakePin(uint8_t pin, int level);  // Input level seen by digitalRead()
+int fakePinOutput(uint8_t pin);        // Last digitalWrite() level
+
+// Serial
+void fakeSerialInput(const char *text);
+std::string fakeSerialOutput();        // Everything printed since the last call
+void fakeSerialEcho(bool echo);        // Also copy Serial output to stdout
+uint32_t fakeSerialFlushes();
+
+// Inputs scheduled on the fake clock. They are applied when the clock passes
+// their time, including while the firmware sits in light sleep.
+void fakeSchedulePin(unsigned long at_ms, uint8_t pin, int level);
+void fakeScheduleSerial(unsigned long at_ms, const char *text);
+void fakeScheduleTap(unsigned long at_ms, uint8_t ss_pin, const uint8_t *uid, uint8_t size);
+void fakeScheduleRemove(unsigned long at_ms, uint8_t ss_pin);
+
+struct FakeSleepStats {
+  uint32_t sleeps;
+  uint64_t slept_us;
+  uint32_t timer_wakes;
+  uint32_t gpio_wakes;
+  uint32_t uart_wakes;
+  uint32_t lost_serial_bytes;  // Received while the UART was stopped
+  uint32_t tx_garbled_bytes;   // Still in the TX FIFO when the UART stopped
+};
+
+const FakeSleepStats &fakeSleepStats();
+void fakeResetSleepStats();
+
+// Tasks run on host threads; with this set xTaskCreatePinnedToCore() fails
+void fakeTaskCreateFails(bool fails);
+
+// SD card
+const char *fakeSdRoot(const char *dir = NULL);  // NULL: a fresh empty directory
+std::string fakeSdPath(const char *path);        // Host path of a file on the card
+void fakeSdWrite(const char *path, const std::string &content);
+std::string fakeSdRead(const char *path);
+void fakeSdMountFails(bool fails);
+void fakeSdMountDelay(unsigned long ms);         // SD.begin() takes this long on the fake clock
+uint32_t fakeSdOpens(const char *path, int core);  // Successful SD.open() calls from each core
+
+// SPI: how often a bus (HSPI, VSPI) was started from each core
+uint32_t fakeSpiStarts(uint8_t bus, int core);
+
+// RFID readers, by chip select pin. A tapped card stays in the field until
+// removed; once halted it is not reported again until it leaves and returns.
+void fakeCardTap(uint8_t ss_pin, const uint8_t *uid, uint8_t size);
+void fakeCardRemove(uint8_t ss_pin);
+uint32_t fakeReaderPolls(uint8_t ss_pin);
+// Off by default. On, polls take their time on the MFRC522: a REQA nobody
+// answers waits out the 25 ms timer, an answer 1 ms, a read (select) 3 ms.
+void fakeReaderTiming(bool on);
+
+// Display
+struct FakeGlyph {
+  int32_t x;
+  int32_t y;
+  uint16_t c;
+};
+
+uint16_t fakeTftPixel(int32_t x, int32_t y);
+std::vector<FakeGlyph> fakeTftGlyphs();  // Glyph cells drawn since the last call
+bool fakeTftSavePng(const char *path);
+
+// Watchdog feeds since boot, and the longest time the task subscribed with
+// esp_task_wdt_add() went without one (since the previous call)
+uint32_t fakeWdtResets();
+uint64_t fakeWdtLongestGapUs();
+
+// WiFi and MQTT: both down until a test brings them up. The broker records
+// every publish, which takes 1.5 ms plus the payload at 1 Mbit/s; taking the
+// link or the broker down drops the connection.
+struct FakeMqttMessage {
+  std::string topic;
+  std::string payload;
+};
+
+void fakeWifiUp(bool up);
+void fakeMqttBrokerUp(bool up);
+std::vector<FakeMqttMessage> fakeMqttMessages();  // Published since the last call
+uint32_t fakeMqttConnects();
@@ -0,0 +1,84 @@
+"""Build card_index.bin for the SD card from card_list.csv.
+
+The firmware expects the index sorted by UID (byte order, same as strcmp)
+with one fixed-size record per card:
+
+    uid          20 bytes, NUL padded (MAX_UID_LEN)
+    slot_mask    uint8, bit i allows relays[i]
+    flags        uint8, 0x01 blocked
+    daily_quota  uint16, minutes per day, 0 for unlimited
+    expiry_day   uint32, days since 1970-01-01, 0 for never
+    reserved     4 bytes, zero
+
+Optional CSV columns after the name, same as loadCardList():
+    uid,name,slots,quota,expiry,blocked
+    e.g. a1b2c3d4,Budi,13,120,2026-12-31,0
+
+Usage: python scripts/build_card_index.py card_list.csv card_index.bin
+"""
+
+import csv
+import datetime
+import struct
+import sys
+
+MAX_UID_LEN = 20
+CARD_RECORD_SIZE = 32
+CARD_BLOCKED = 0x01
+RECORD_FORMAT = "<%dsBBHI4x" % MAX_UID_LEN
+
+
+def parse_policy(columns):
+    """Returns (slot_mask, flags, daily_quota, expiry_day) from the policy columns."""
+    columns = [c.strip() for c in columns] + [""] * 4
+    slots, quota, expiry, blocked = columns[:4]
+
+    slot_mask = 0xFF
+    if slots and slots != "*":
+        slot_mask = 0
+        for c in slots:
+            if c < "1" or c > "8":
+                raise ValueError("invalid slot list: %s" % slots)
+            slot_mask |= 1 << (ord(c) - ord("1"))
+
+    daily_quota = int(quota) if quota else 0
+
+    expiry_day = 0
+    if expiry:
+        date = datetime.datetime.strptime(expiry, "%Y-%m-%d").date()
+        expiry_day = (date - datetime.date(1970, 1, 1)).days
+
+    flags = CARD_BLOCKED if blocked == "1" else 0
+    return slot_mask, flags, daily_quota, expiry_day
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        return 1
+
+    src, dst = sys.argv[1], sys.argv[2]
+
+    cards = {}
+    with open(src, newline="", encoding="utf-8") as f:
+        for row in csv.reader(f):
+            if len(row) < 2 or not row[0].strip():
+                continue  # Same rule as loadCardList(): skip lines without a comma
+            uid = row[0].strip().encode("ascii")
+            if len(uid) >= MAX_UID_LEN:
+                print("Skipping UID longer than %d characters: %s" % (MAX_UID_LEN - 1, row[0]))
+                continue
+            cards[uid] = parse_policy(row[2:])
+
+    assert struct.calcsize(RECORD_FORMAT) == CARD_RECORD_SIZE
+
+    with open(dst, "wb") as f:
+        for uid in sorted(cards):
+            f.write(struct.pack(RECORD_FORMAT, uid, *cards[uid]))
+
+    print("Wrote %d cards to %s" % (len(cards), dst))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
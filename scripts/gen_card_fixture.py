@@ -0,0 +1,48 @@
+"""Generate a synthetic card_list.csv for sizing the card index.
+
+UIDs are random 4-byte (and 1 in 8 7-byte) MIFARE UIDs written the way the
+firmware formats them (lowercase hex, no zero padding). Every 16th card gets
+policy columns, so the index carries a mix of restricted and default cards.
+The same seed always gives the same list.
+
+Usage: python scripts/gen_card_fixture.py COUNT card_list.csv [SEED]
+Then:  python scripts/build_card_index.py card_list.csv card_index.bin
+"""
+
+import random
+import sys
+
+
+def format_uid(uid):
+    return "".join("%x" % b for b in uid)
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        print(__doc__)
+        return 1
+
+    count = int(sys.argv[1])
+    dst = sys.argv[2]
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) == 4 else 2026)
+
+    seen = set()
+    with open(dst, "w", encoding="ascii", newline="\n") as f:
+        while len(seen) < count:
+            size = 7 if rng.randrange(8) == 0 else 4
+            uid = format_uid(rng.getrandbits(8) for _ in range(size))
+            if uid in seen:
+                continue
+            seen.add(uid)
+
+            line = "%s,Fleet %06d" % (uid, len(seen))
+            if len(seen) % 16 == 0:
+                line += ",%d,%d,2030-12-31,0" % (rng.randrange(1, 5), rng.choice((60, 120, 240)))
+            f.write(line + "\n")
+
+    print("Wrote %d cards to %s" % (count, dst))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
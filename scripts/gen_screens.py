@@ -0,0 +1,244 @@
+"""Generate include/screens_gen.h: the static screens, their layout and their
+pre-rendered, RLE compressed images.
+
+Every screen that only shows catalog text is laid out here once, per language.
+The layout (string id and position of each text block) is exported for the
+firmware's drawText() path, and the same layout is rendered with the GLCD font
+from TFT_eSPI into the images. Lines with a %s argument are left blank in the
+image; the firmware draws their text block over it.
+
+All static text is drawn at text size 2 on even coordinates, so images are
+stored at half resolution and every row is emitted twice by the decoder.
+Encoding, per half-resolution row:
+    n            number of runs, 0 repeats the previous row
+    run[n]       run lengths in half pixels, alternating BG / FG, BG first
+
+Runs as a PlatformIO script (the header is written when main.cpp or a test
+suite is queued for compiling, once TFT_eSPI is installed), or standalone
+from the project root:
+    python scripts/gen_screens.py path/to/TFT_eSPI/Fonts/glcdfont.c
+"""
+
+import os
+import re
+import sys
+
+WIDTH, HEIGHT = 480, 320
+SCALE = 2
+GLYPH_WIDTH = 6
+
+# The only copy of the static screen layouts. Each screen is a list of
+# (string id, x, y, align, gap after); y None continues below the previous
+# string, "center" centers the single block vertically.
+CONFIRM = [("CONFIRM_TITLE", 30, 30, "left", 10), (None, 30, None, "left", 10),
+           ("SEPARATOR", 30, None, "left", 30), ("PRESS_L_CONTINUE", 30, None, "left", 10),
+           ("PRESS_R_BACK", 30, None, "left", 0)]
+
+
+def message(first, last="PRESS_ANY_EXIT"):
+    return [(first, 30, 30, "left", 10), ("SEPARATOR", 30, None, "left", 40), (last, 30, None, "left", 0)]
+
+
+def centered(sid):
+    return [(sid, WIDTH // 2, "center", "center", 0)]
+
+
+SCREENS = [
+    ("UNAUTHORIZED", centered("UNAUTHORIZED")),
+    ("DENIED_BLOCKED", centered("DENIED_BLOCKED")),
+    ("DENIED_EXPIRED", centered("DENIED_EXPIRED")),
+    ("DENIED_QUOTA", centered("DENIED_QUOTA")),
+    ("LOGOUT", centered("LOGOUT")),
+    ("SCAN_OK", [("CARD_DETECTED", WIDTH // 2, HEIGHT // 2 - 28, "center", 20), ("UID_LINE", WIDTH // 2, None, "center", 0)]),
+    ("CONFIRM_ENABLE", [CONFIRM[0], ("CONFIRM_ENABLE",) + CONFIRM[1][1:]] + CONFIRM[2:]),
+    ("CONFIRM_DISABLE", [CONFIRM[0], ("CONFIRM_DISABLE",) + CONFIRM[1][1:]] + CONFIRM[2:]),
+    ("ENABLE_SUCCESS", message("ENABLE_SUCCESS")),
+    ("DISABLE_SUCCESS", message("DISABLE_SUCCESS")),
+    ("CHARGER_FULL", message("CHARGER_FULL")),
+    ("DOOR_INSERT", message("ENABLE_SUCCESS", "INSERT_BATTERY")),
+    ("DOOR_REMOVE", message("DISABLE_SUCCESS", "REMOVE_BATTERY")),
+]
+
+
+def load_font(path):
+    with open(path, encoding="latin-1") as f:
+        source = f.read()
+    body = source[source.index("font[]"):]
+    values = [int(v, 16) for v in re.findall(r"0x([0-9A-Fa-f]{2})", body)]
+    if len(values) < 256 * 5:
+        raise ValueError("unexpected GLCD font size in %s" % path)
+    return values
+
+
+def place(layouts, screen):
+    """Returns (string id, x, top, align) per text block of a screen."""
+    placed = []
+    y = 0
+    for sid, x, y_spec, align, gap in screen:
+        size, lines = layouts[sid]
+        if y_spec == "center":
+            y = (HEIGHT - len(lines) * 10 * size) // 2
+        elif y_spec is not None:
+            y = y_spec
+        placed.append((sid, x, y, align))
+        y += len(lines) * 10 * size + gap
+    return placed
+
+
+def render(font, layouts, placed):
+    pixels = [[0] * WIDTH for _ in range(HEIGHT)]
+
+    for sid, x, y, align in placed:
+        size, lines = layouts[sid]
+        line_height = 10 * size
+
+        for i, line in enumerate(lines):
+            top = y + i * line_height
+            if "%s" in line:
+                continue  # Drawn at runtime
+
+            width = len(line) * GLYPH_WIDTH * size
+            left = x - width // 2 if align == "center" else x
+            if size != SCALE or left % SCALE or top % SCALE:
+                raise ValueError("static text must be size %d on even coordinates: %r" % (SCALE, line))
+
+            for c, ch in enumerate(line.encode("latin-1")):
+                for col in range(5):
+                    bits = font[ch * 5 + col]
+                    for row in range(8):
+                        if bits & (1 << row):
+                            px, py = left + (c * GLYPH_WIDTH + col) * size, top + row * size
+                            for dy in range(size):
+                                for dx in range(size):
+                                    pixels[py + dy][px + dx] = 1
+
+    return pixels
+
+
+def encode(pixels):
+    out = bytearray()
+    previous = None
+    for y in range(0, HEIGHT, SCALE):
+        row = pixels[y][::SCALE]
+        if row == previous:
+            out.append(0)
+            continue
+        runs, color, length = [], 0, 0
+        for p in row:
+            if p == color:
+                length += 1
+            else:
+                runs.append(length)
+                color, length = p, 1
+        runs.append(length)
+        out.append(len(runs))
+        out.extend(runs)
+        previous = row
+    return out
+
+
+def generate(project_dir, font_path):
+    sys.path.insert(0, os.path.join(project_dir, "scripts"))
+    from gen_strings import load_layouts, write_if_changed, read_catalog
+
+    languages, _ = read_catalog(project_dir)
+    layouts = load_layouts(project_dir)
+    font = load_font(font_path)
+
+    out = []
+    out.append("// Generated by scripts/gen_screens.py from lang/strings.csv, do not edit")
+    out.append("#pragma once")
+    out.append("")
+    out.append('#include "strings_gen.h"')
+    out.append("")
+    out.append("#define SCREEN_IMAGE_SCALE %d" % SCALE)
+    out.append("")
+    out.append("enum ScreenImageId {")
+    for name, _ in SCREENS:
+        out.append("  SCREEN_%s," % name)
+    out.append("  SCREEN_COUNT")
+    out.append("};")
+    out.append("")
+    out.append("// A text block of a static screen, drawn with drawText()")
+    out.append("struct ScreenText {")
+    out.append("  StringId id;")
+    out.append("  int16_t x;")
+    out.append("  int16_t y;         // Top of the first line")
+    out.append("  bool centered;")
+    out.append("};")
+    out.append("")
+    out.append("struct ScreenLayout {")
+    out.append("  const ScreenText *texts;")
+    out.append("  uint8_t count;")
+    out.append("};")
+    out.append("")
+    out.append("struct ScreenImage {")
+    out.append("  const uint8_t *data;")
+    out.append("  uint32_t size;")
+    out.append("};")
+    out.append("")
+
+    layout_table = []
+    image_table = []
+    total = 0
+    for lang in languages:
+        layout_entries = []
+        image_entries = []
+        for name, screen in SCREENS:
+            placed = place(layouts[lang], screen)
+            symbol = "screen_%s_%s" % (lang.split("_")[0].lower(), name.lower())
+
+            out.append("const ScreenText %s_text[] = {" % symbol)
+            for sid, x, y, align in placed:
+                out.append("  {STR_%s, %d, %d, %s}," % (sid, x, y, "true" if align == "center" else "false"))
+            out.append("};")
+            layout_entries.append("    {%s_text, %d}, // SCREEN_%s" % (symbol, len(placed), name))
+
+            data = encode(render(font, layouts[lang], placed))
+            total += len(data)
+            out.append("const uint8_t %s[] PROGMEM = {" % symbol)
+            for i in range(0, len(data), 24):
+                out.append("  " + ", ".join("%d" % b for b in data[i:i + 24]) + ",")
+            out.append("};")
+            image_entries.append("    {%s, %d}, // SCREEN_%s" % (symbol, len(data), name))
+        layout_table.append("  { // %s" % lang)
+        layout_table.extend(layout_entries)
+        layout_table.append("  },")
+        image_table.append("  { // %s" % lang)
+        image_table.extend(image_entries)
+        image_table.append("  },")
+
+    out.append("const ScreenLayout screen_layouts[LANG_COUNT][SCREEN_COUNT] = {")
+    out.extend(layout_table)
+    out.append("};")
+    out.append("")
+    out.append("const ScreenImage screen_images[LANG_COUNT][SCREEN_COUNT] = {")
+    out.extend(image_table)
+    out.append("};")
+    out.append("")
+
+    write_if_changed(os.path.join(project_dir, "include", "screens_gen.h"), "\n".join(out), "gen_screens")
+    print("gen_screens: %d screens, %d bytes of image data" % (len(SCREENS) * len(languages), total))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    generated = []
+
+    def _generate(node):
+        if not generated:
+            generated.append(True)
+            font_path = os.path.join(env.subst("$PROJECT_LIBDEPS_DIR"), env.subst("$PIOENV"),  # noqa: F821
+                                     "TFT_eSPI", "Fonts", "glcdfont.c")
+            generate(env.subst("$PROJECT_DIR"), font_path)  # noqa: F821
+        return node
+
+    # TFT_eSPI is only installed once the build starts, so render when the
+    # first source that includes the header is queued: src/main.cpp, or the
+    # test_main.cpp of a native test suite
+    env.AddBuildMiddleware(_generate, "*main.cpp")  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if len(sys.argv) != 2:
+            sys.exit(__doc__)
+        generate(os.getcwd(), sys.argv[1])
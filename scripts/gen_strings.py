@@ -0,0 +1,166 @@
+"""Generate include/strings_gen.h from lang/strings.csv.
+
+Runs as a PlatformIO pre: script, or standalone from the project root:
+    python scripts/gen_strings.py
+
+Every string is wrapped for its box at build time using the advance of the
+built-in GLCD font (6 px per glyph at text size 1), so the firmware never
+measures text. A string that cannot fit its box in STRING_MAX_LINES lines
+fails the build. Lines containing %s are checked with max_arg glyphs for the
+argument and are never wrapped.
+
+CSV columns: id, size (text size), box (width in px), max_arg, then one
+column per language. "\\n" in a string forces a line break.
+"""
+
+import csv
+import os
+import sys
+
+GLYPH_WIDTH = 6
+STRING_MAX_LINES = 3
+
+
+
+def text_width(text, size, max_arg):
+    if "%s" in text:
+        return (len(text) - 2 + max_arg) * GLYPH_WIDTH * size
+    return len(text) * GLYPH_WIDTH * size
+
+
+def wrap(text, size, box, max_arg):
+    lines = []
+    for paragraph in text.split("\\n"):
+        if "%s" in paragraph:
+            lines.append(paragraph)
+            continue
+
+        line = ""
+        for word in paragraph.split(" "):
+            candidate = word if not line else line + " " + word
+            if line and text_width(candidate, size, 0) > box:
+                lines.append(line)
+                line = word
+            else:
+                line = candidate
+        lines.append(line)
+
+    for line in lines:
+        if text_width(line, size, max_arg) > box:
+            raise ValueError("does not fit %d px: %r" % (box, line))
+    if len(lines) > STRING_MAX_LINES:
+        raise ValueError("needs %d lines, at most %d allowed" % (len(lines), STRING_MAX_LINES))
+    return lines
+
+
+def c_string(text):
+    return '"%s"' % text.replace("\\", "\\\\").replace('"', '\\"')
+
+
+def read_catalog(project_dir):
+    """Returns (languages, rows) from lang/strings.csv."""
+    with open(os.path.join(project_dir, "lang", "strings.csv"), newline="", encoding="utf-8") as f:
+        rows = list(csv.reader(f))
+    return rows[0][4:], [r for r in rows[1:] if r]
+
+
+def load_layouts(project_dir):
+    """Returns {language: {id: (size, lines)}}, used by gen_screens.py."""
+    languages, rows = read_catalog(project_dir)
+    layouts = {}
+    for li, lang in enumerate(languages):
+        layouts[lang] = {}
+        for row in rows:
+            size, box, max_arg = int(row[1]), int(row[2]), int(row[3])
+            layouts[lang][row[0]] = (size, wrap(row[4 + li], size, box, max_arg))
+    return layouts
+
+
+def generate(project_dir):
+    dst = os.path.join(project_dir, "include", "strings_gen.h")
+    languages, rows = read_catalog(project_dir)
+
+    out = []
+    out.append("// Generated by scripts/gen_strings.py from lang/strings.csv, do not edit")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("#define STRING_MAX_LINES %d" % STRING_MAX_LINES)
+    out.append("#define GLYPH_WIDTH %d // GLCD font advance at text size 1" % GLYPH_WIDTH)
+    out.append("")
+    out.append("enum Language {")
+    for lang in languages:
+        out.append("  LANG_%s," % lang.split("_")[0].upper())
+    out.append("  LANG_COUNT")
+    out.append("};")
+    out.append("")
+    out.append("enum StringId {")
+    for row in rows:
+        out.append("  STR_%s," % row[0])
+    out.append("  STR_COUNT")
+    out.append("};")
+    out.append("")
+    out.append("struct TextLine {")
+    out.append("  const char *text;")
+    out.append("  uint16_t width;   // Pixels, without the %s argument")
+    out.append("  bool has_arg;")
+    out.append("};")
+    out.append("")
+    out.append("struct TextLayout {")
+    out.append("  uint8_t text_size;")
+    out.append("  uint8_t line_count;")
+    out.append("  TextLine lines[STRING_MAX_LINES];")
+    out.append("};")
+    out.append("")
+    out.append("const TextLayout string_table[LANG_COUNT][STR_COUNT] = {")
+
+    errors = []
+    for li, lang in enumerate(languages):
+        out.append("  { // %s" % lang)
+        for row in rows:
+            sid, size, box, max_arg = row[0], int(row[1]), int(row[2]), int(row[3])
+            text = row[4 + li]
+            try:
+                lines = wrap(text, size, box, max_arg)
+            except ValueError as e:
+                errors.append("%s [%s]: %s" % (sid, lang, e))
+                continue
+            entries = ", ".join(
+                "{%s, %d, %s}" % (c_string(l), text_width(l, size, 0), "true" if "%s" in l else "false")
+                for l in lines)
+            out.append("    {%d, %d, {%s}}, // STR_%s" % (size, len(lines), entries, sid))
+        out.append("  },")
+    out.append("};")
+    out.append("")
+    out.append("// Glyphs the %s argument may take, checked against the texts passed in")
+    out.append("constexpr uint8_t string_max_arg[STR_COUNT] = {")
+    for row in rows:
+        out.append("  %d, // STR_%s" % (int(row[3]), row[0]))
+    out.append("};")
+    out.append("")
+
+    if errors:
+        for e in errors:
+            print("gen_strings: " + e)
+        sys.exit("gen_strings: %d string(s) do not fit their box" % len(errors))
+
+    write_if_changed(dst, "\n".join(out), "gen_strings")
+
+
+def write_if_changed(path, text, tool):
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == text:
+                return  # Unchanged, keep the timestamp so nothing rebuilds
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    print("%s: wrote %s" % (tool, path))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.getcwd())
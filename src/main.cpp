@@ -6,29 +6,125 @@
 #include <Wire.h>
 #include <MFRC522.h>
 #include <Bounce2.h>
-
-#define RFID_SCK  14
-#define RFID_MISO 12
-#define RFID_MOSI 13
-#define RFID_SS   15
-#define RFID_RST  -1
-
-#define SD_CS 5
-
-#define BUTTON_L 33
-#define BUTTON_C 34
-#define BUTTON_R 35
-#define DOOR_SENSOR 17
-
-#define RELAY_1 27
-#define RELAY_2 25
-#define RELAY_3 32
-#define RELAY_4 26
-#define RELAY_5 16
-
+#include "strings_gen.h" // Generated from lang/strings.csv by scripts/gen_strings.py
+#include "board_profile.h" // Pins and charger slots, selected by a -DBOARD_<NAME> build flag
+
+// Static screens are blitted from pre-rendered images (scripts/gen_screens.py),
+// build with -DUSE_SCREEN_IMAGES=0 to draw their layout with drawText() instead
+#ifndef USE_SCREEN_IMAGES
+#define USE_SCREEN_IMAGES 1
+#endif
+
+#include "screens_gen.h" // Layouts of the static screens, and their images
+
+// Build with -DSCREEN_TIMING=1 to log how long each static screen takes to draw
+#ifndef SCREEN_TIMING
+#define SCREEN_TIMING 0
+#endif
+
+// The scan screen drops to light sleep between deadlines, build with
+// -DUSE_IDLE_SLEEP=0 to keep the CPU spinning (backlight dimming stays).
+// The UART stops while asleep: serial input wakes it but its first byte is
+// lost, and the station then stays awake for SERIAL_AWAKE_TIME.
+#ifndef USE_IDLE_SLEEP
+#define USE_IDLE_SLEEP 1
+#endif
+
+// Build with -DRENDER_COST=1 to count pixels, SPI bytes and draw calls per screen
+// and compare them against render_baselines[] below
+#ifndef RENDER_COST
+#define RENDER_COST 0
+#endif
+
+// Optional WiFi/MQTT telemetry, see the telemetry env in platformio.ini
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+
+// Build with -DSTATION_BENCH=1 (bench env) to print microbenchmarks at boot
+#ifndef STATION_BENCH
+#define STATION_BENCH 0
+#endif
+
+#if TELEMETRY
+#include <WiFi.h>
+#include <PubSubClient.h>
+#endif
+#include <esp_heap_caps.h>
+#include <esp_task_wdt.h>
+#include <esp_system.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <driver/uart.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <sys/time.h>
+#include <atomic>
+
+#ifndef MAX_CARDS
 #define MAX_CARDS 50 // Temporary value
+#endif
 #define MAX_UID_LEN 20
 #define MAX_NAME_LEN 30
+// Longest card_list.csv line plus its NUL: uid,name,slots,quota,YYYY-MM-DD,blocked
+// (the NUL room of each field holds the comma after it)
+#define CARD_LINE_LEN (MAX_UID_LEN + MAX_NAME_LEN + 9 + 6 + 11 + 1 + 1)
+
+// Fleet card index on SD (see scripts/build_card_index.py)
+#define CARD_INDEX_PATH "/card_index.bin"
+#define CARD_RECORD_SIZE 32
+#define CARD_BLOCK_SIZE 512
+#define CARD_RECORDS_PER_BLOCK (CARD_BLOCK_SIZE / CARD_RECORD_SIZE)
+#define CARD_CACHE_BLOCKS 8    // LRU block cache, 4 KB
+#define CARD_FENCE_MAX 128     // First UID of every Nth block kept in RAM
+#define CARD_BLOOM_BITS_PER_CARD 8
+#define CARD_BLOOM_MAX_BYTES (80 * 1024) // Larger fleets get fewer bits per card
+#define CARD_BLOOM_HEAP_MARGIN (16 * 1024) // Left in the largest free block after the filter
+#define CARD_BLOOM_HASHES 5 // At 8 bits per card, fewer for a smaller filter
+
+// Telemetry lines: "epoch,uptime_s,type,slot,uid,value", published in batches
+#ifndef TELEMETRY_SSID
+#define TELEMETRY_SSID ""
+#endif
+#ifndef TELEMETRY_PASSWORD
+#define TELEMETRY_PASSWORD ""
+#endif
+#if TELEMETRY && !defined(TELEMETRY_BROKER)
+#error "TELEMETRY=1 needs -DTELEMETRY_BROKER=\"host\" (STATION_MQTT_BROKER in the telemetry env)"
+#endif
+#if TELEMETRY
+static_assert(sizeof(TELEMETRY_BROKER) > 1, "TELEMETRY_BROKER is empty, set STATION_MQTT_BROKER");
+#endif
+#ifndef TELEMETRY_PORT
+#define TELEMETRY_PORT 1883
+#endif
+#define TELEMETRY_BACKLOG_PATH "/telemetry.log" // Lines that could not be queued while offline
+#define TELEMETRY_LINE_LEN 96
+#define TELEMETRY_QUEUE_LEN 16
+#define TELEMETRY_BATCH_MAX 8
+
+// Per-card policy and daily usage
+#define CARD_BLOCKED 0x01
+#define USAGE_PATH "/card_usage.bin"
+#define USAGE_TABLE_SIZE 64    // Cards tracked per day
+#define USAGE_MAX_PROBE 4      // Bounded probing keeps every check constant-time
+#define USAGE_UPTIME_DAY 0x8000 // Day counted from boot, meaningless after a reset
+
+// Recently seen cards, so a card left on the reader is not processed again
+#define TAP_CACHE_SIZE 4
+
+// Usage analytics: aggregates in a snapshot file plus a journal of sessions
+// recorded since, folded into a new snapshot (compaction) now and then
+#define ANALYTICS_PATH "/analytics.bin"
+#define ANALYTICS_TMP_PATH "/analytics.tmp"
+#define ANALYTICS_JOURNAL_PATH "/analytics.log"
+#define ANALYTICS_CARDS 64           // Least recently seen card is dropped beyond this
+#define ANALYTICS_COMPACT_RECORDS 32 // Journal length that triggers a compaction
+#define COMMAND_LEN 32
 
 #define BG_COLOR TFT_WHITE
 #define TXT_COLOR_1 TFT_BLACK
@@ -38,6 +134,35 @@ const unsigned long RELAY_ON_TIME = (1 * 60 + 30) * 1000; // 90 seconds
 const unsigned long WARNING_TIMEOUT = 10 * 1000; // 10 seconds
 const unsigned long CHARGING_SCREEN_TIMEOUT = 2 * 1000; // 2 seconds
 const unsigned long int LOADING_SCREEN_TIMEOUT = 2 * 1000; // 2 seconds 
+const unsigned long HEAP_REPORT_INTERVAL = 60 * 1000; // 60 seconds
+const int HEAP_FRAG_WARN_DELTA = 10; // Percent points above the first report
+const int LOOP_WDT_TIMEOUT_S = 5; // A loop pass stuck longer than this resets the board
+const uint32_t STALL_RECORD_MAGIC = 0x5741544B;
+const unsigned long USAGE_CHECKPOINT_INTERVAL = 5 * 60 * 1000; // 5 minutes
+const uint32_t USAGE_MAGIC = 0x55534731;
+const long TIME_UTC_OFFSET = 7 * 3600; // WIB, quota days roll over at local midnight
+const time_t CLOCK_VALID_AFTER = 1600000000; // 2020-09-13, an earlier clock was never set
+const unsigned long TAP_SUPPRESS_TTL = 3 * 1000; // Repeat reads of the same card within this window are ignored
+const unsigned long READER_POLL_MIN = 10;  // Poll interval right after a read, ms
+const unsigned long READER_POLL_MAX = 80;  // Idle readers back off up to this, ms
+const unsigned long BOOT_STORAGE_TIMEOUT = 30 * 1000; // 30 seconds
+const unsigned long RENDER_FRAME_BUDGET_US = 8000; // Drawing time per loop pass
+const unsigned long SCAN_DOTS_INTERVAL = 500; // Milliseconds per animation step
+const int RENDER_BAND_HEIGHT = 16; // Rows cleared or blitted per slice
+const unsigned long IDLE_DIM_TIMEOUT = 30 * 1000; // Backlight dims after this long without input
+const unsigned long IDLE_SLEEP_DELAY = 100; // Stay awake briefly after input so debouncing can finish
+const unsigned long IDLE_MIN_SLEEP = 5; // Shorter gaps are not worth the wake-up cost, ms
+const unsigned long SERIAL_AWAKE_TIME = 10 * 1000; // No light sleep this long after serial input
+const int UART_WAKE_THRESHOLD = 3; // RX edges that wake the chip, the byte carrying them is lost
+const unsigned long TELEMETRY_SNAPSHOT_INTERVAL = 60 * 1000; // 60 seconds
+const uint32_t TELEMETRY_BACKLOG_MAX = 256 * 1024; // Newer lines are dropped beyond this
+const unsigned long TELEMETRY_SPILL_DELAY = 5 * 1000; // Offline lines gather this long per SD append
+const unsigned long MQTT_RETRY_MIN = 2 * 1000;
+const unsigned long MQTT_RETRY_MAX = 60 * 1000;
+const unsigned long ANALYTICS_COMPACT_INTERVAL = 30 * 60 * 1000; // 30 minutes
+const uint32_t ANALYTICS_MAGIC = 0x414E4C31;
+const uint8_t BACKLIGHT_FULL = 255;
+const uint8_t BACKLIGHT_DIM = 40;
 
 unsigned long int loading_timer = 0;
 unsigned long int warning_timer = 0;
@@ -45,12 +170,225 @@ int last_menu_index = -1;
 
 bool isScanWaitShow = false;
 
+Language current_language = LANG_ID;
+
+enum TextAlign {
+  ALIGN_LEFT,
+  ALIGN_CENTER
+};
+
+void costBegin(const char *screen);
+
+// Logs how long a screen switch took, for comparing image and drawn screens
+struct ScreenTimer {
+  const char *name;
+  unsigned long start;
+
+  ScreenTimer(const char *screen_name) {
+    name = screen_name;
+    start = micros();
+    costBegin(screen_name);
+  }
+
+  ~ScreenTimer() {
+#if SCREEN_TIMING
+    Serial.printf("[screen] %s %lu us\n", name, micros() - start);
+#endif
+  }
+};
+
+// Render scheduler
+// Screens are not drawn where they are requested: requests set dirty flags and
+// renderStep() draws them in slices (a band of rows, one menu row, ...) until
+// the per-pass budget is used up, so inputs and the reader keep being polled.
+#define DIRTY_CLEAR       0x01 // Clear the screen band by band
+#define DIRTY_IMAGE       0x02 // Pre-rendered image, band by band
+#define DIRTY_IMAGE_ARG   0x04 // Dynamic line over the image
+#define DIRTY_SCAN_PROMPT 0x08
+#define DIRTY_SCAN_DOTS   0x10
+#define DIRTY_MENU_ROWS   0x20 // Rows listed in menu_rows
+#define DIRTY_COUNTDOWN   0x40 // Remaining time of the active slots
+
+#define COUNTDOWN_LEN 5 // "mm:ss"
+#define STATUS_STRIP_Y 262
+
+struct RenderState {
+  uint16_t dirty;
+  int band;                   // Next band of the clear or the image
+  uint8_t menu_rows;          // Charger list rows waiting for a redraw
+
+  // Image job
+  int image;
+  const char *image_name;
+  int image_arg_id;           // StringId of the dynamic line, -1 for none
+  const char *image_arg;
+  const uint8_t *image_data;  // Next encoded row
+  const uint8_t *image_runs;  // Runs of the last decoded row
+  uint8_t image_run_count;
+  unsigned long image_start;
+
+  // Scan screen animation
+  unsigned long dots_timer;
+  int dots_step;
+
+  unsigned long countdown_timer;
+
+  // Frame statistics
+  unsigned long max_frame_us;
+  uint32_t over_budget_frames;
+};
+
+RenderState render = {0, 0, 0, -1, NULL, -1, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0};
+
 // RFID Setup
 SPIClass hspi(HSPI);
-MFRC522 mfrc522(RFID_SS, RFID_RST);
+// The SD card keeps its own bus object, RFID init below replaces the global SPI
+SPIClass vspi(VSPI);
+
+// One reader per entry of READERS (board_profile.h): the front panel plus any
+// bay readers. A card read at a bay reader preselects that slot; worst-case
+// detection latency is about READER_POLL_MAX plus one loop pass per reader,
+// as one reader is polled per pass.
+MFRC522 mfrc522[READER_COUNT]; // Pins are given to PCD_Init() in setup()
+
+struct ReaderState {
+  unsigned long next_poll;
+  unsigned long interval;    // Doubles while idle, back to READER_POLL_MIN on a read
+  uint32_t polls;
+  uint32_t reads;
+};
+
+ReaderState readers[READER_COUNT];
+
+int next_reader = 0;         // Round-robin position
+int scanned_reader = 0;      // Reader of the last accepted read
+int current_bay = -1;        // Slot the last card was read at, -1 for the front panel
 
 // TFT Display Setup
+#if RENDER_COST
+// Cost model of a draw call: every primitive opens an address window
+// (CASET, PASET and RAMWR with their arguments), then sends 16-bit pixels
+const uint32_t COST_WINDOW_BYTES = 11;
+const int COST_REGRESSION_PERCENT = 10;
+
+struct RenderCost {
+  const char *screen;        // Screen being measured, NULL between screens
+  uint32_t pixels;           // Counts stay readable until the next costBegin()
+  uint32_t spi_bytes;
+  uint32_t calls;
+  uint32_t regressions;      // Screens over their baseline since boot
+};
+
+RenderCost render_cost = {NULL, 0, 0, 0, 0};
+
+// Reference costs, the worst case over both languages and every argument
+// (test/render_cost.h measures them); screens not listed are reported
+// without a comparison. Image screens without an argument line are fixed:
+// 20 bands of 480x16.
+struct RenderBaseline {
+  const char *screen;
+  uint32_t pixels;
+  uint32_t spi_bytes;
+  uint32_t calls;
+};
+
+const RenderBaseline render_baselines[] = {
+  // Drawn the same in both builds, with every slot charging
+  {"scan_wait",       165676, 333167, 165},
+  {"charger_list",    284560, 573135, 365},
+#if USE_SCREEN_IMAGES
+  {"unauthorized",    153600, 307420, 20},
+  {"card_denied",     153600, 307420, 20},
+  {"logout",          153600, 307420, 20},
+  {"enable_success",  153600, 307420, 20},
+  {"disable_success", 153600, 307420, 20},
+  {"charger_full",    153600, 307420, 20},
+  {"door_lock",       153600, 307420, 20},
+  // Image plus the argument line: a 7-byte UID, the longest slot name
+  {"scan_ok",         157056, 314530, 38},
+  {"enable_conf",     159360, 319270, 50},
+  {"disable_conf",    159168, 318875, 49},
+#else
+  // drawText() screens, the costlier language of the two
+  {"unauthorized",    158016, 316296, 24},
+  {"card_denied",     158400, 317086, 26},
+  {"logout",          155904, 311951, 13},
+  {"enable_success",  171648, 344341, 95},
+  {"disable_success", 172224, 345526, 98},
+  {"charger_full",    173184, 347501, 103},
+  {"door_lock",       172032, 345131, 97},
+  {"scan_ok",         160320, 321036, 36},
+  {"enable_conf",     178176, 357771, 129},
+  {"disable_conf",    177984, 357376, 128},
+#endif
+  {NULL, 0, 0, 0}
+};
+
+// Counts what reaches the panel. Primitives called from inside another
+// recorded primitive (a glyph drawn with fillRect, ...) are not counted twice.
+class RecordingTFT : public TFT_eSPI {
+public:
+  using TFT_eSPI::drawChar;
+
+  void recordBlock(int32_t w, int32_t h) {
+    if (depth > 0 || w <= 0 || h <= 0) return;
+    render_cost.pixels += w * h;
+    render_cost.spi_bytes += COST_WINDOW_BYTES + 2 * w * h;
+    render_cost.calls++;
+  }
+
+  void drawPixel(int32_t x, int32_t y, uint32_t color) override {
+    recordBlock(1, 1);
+    depth++;
+    TFT_eSPI::drawPixel(x, y, color);
+    depth--;
+  }
+
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) override {
+    recordBlock(w, 1);
+    depth++;
+    TFT_eSPI::drawFastHLine(x, y, w, color);
+    depth--;
+  }
+
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) override {
+    recordBlock(1, h);
+    depth++;
+    TFT_eSPI::drawFastVLine(x, y, h, color);
+    depth--;
+  }
+
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) override {
+    recordBlock(w, h);
+    depth++;
+    TFT_eSPI::fillRect(x, y, w, h, color);
+    depth--;
+  }
+
+  // GLCD glyph cell, 6x8 per size step
+  void drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size) override {
+    recordBlock(6 * size, 8 * size);
+    depth++;
+    TFT_eSPI::drawChar(x, y, c, color, bg, size);
+    depth--;
+  }
+
+  int16_t drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font) override {
+    recordBlock(6 * textsize, 8 * textsize);
+    depth++;
+    int16_t width = TFT_eSPI::drawChar(uniCode, x, y, font);
+    depth--;
+    return width;
+  }
+
+private:
+  int depth = 0;
+};
+
+RecordingTFT tft;
+#else
 TFT_eSPI tft = TFT_eSPI();
+#endif
 
 Bounce l_button;
 Bounce c_button;
@@ -68,64 +406,467 @@ enum Pages {
   CHARGER_DISABLE_CONF,
   CHARGER_DISABLE_SUCCESS,
   LOGOUT_PAGE,
-  CHARGER_FULL
+  CHARGER_FULL,
+  CARD_DENIED
+};
+
+// Peripheral the loop is currently waiting on, for stall attribution
+enum Peripheral {
+  PERIPH_NONE,
+  PERIPH_TFT,
+  PERIPH_SD,
+  PERIPH_RFID
+};
+
+const char* page_names[] = {
+  "SCAN_WAIT",
+  "SCAN_OK",
+  "UNAUTHORIZED_CARD",
+  "CHOOSE_CHARGER",
+  "CHARGER_ENABLE_CONF",
+  "CHARGER_ENABLE_SUCCESS",
+  "DOOR_LOCK",
+  "CHARGER_DISABLE_CONF",
+  "CHARGER_DISABLE_SUCCESS",
+  "LOGOUT_PAGE",
+  "CHARGER_FULL",
+  "CARD_DENIED"
+};
+
+const char* peripheral_names[] = {
+  "none",
+  "TFT",
+  "SD",
+  "RFID"
+};
+
+// Kept in RTC memory so it survives the watchdog reset
+struct StallRecord {
+  uint32_t magic;
+  uint8_t page;
+  uint8_t peripheral;
+  uint32_t uptime;           // millis() when the peripheral call started
+  uint32_t stack_high_water; // Lowest free stack of the loop task, in bytes
+};
+
+RTC_NOINIT_ATTR StallRecord stall_record;
+
+// Marks a peripheral call for the lifetime of the scope
+struct PeripheralScope {
+  uint8_t previous;
+
+  PeripheralScope(Peripheral peripheral) {
+    previous = stall_record.peripheral;
+    stall_record.peripheral = peripheral;
+    stall_record.uptime = millis();
+  }
+
+  ~PeripheralScope() {
+    stall_record.peripheral = previous;
+  }
+};
+
+// Boot sequence steps, timed for the boot report
+enum BootStep {
+  BOOT_TFT,
+  BOOT_SPLASH,
+  BOOT_RFID,
+  BOOT_SD,
+  BOOT_CARDS,
+  BOOT_STEP_COUNT
+};
+
+const char* boot_step_names[] = {
+  "tft_init",
+  "splash",
+  "rfid_init",
+  "sd_mount",
+  "card_load"
+};
+
+struct BootTiming {
+  unsigned long start;  // micros()
+  unsigned long end;
+  int core;
+  bool ok;
 };
 
+BootTiming boot_timings[BOOT_STEP_COUNT];
+SemaphoreHandle_t storage_ready;
+// Set on core 1 by takeStorageResult(), possibly after the telemetry task on
+// core 0 has started reading it
+std::atomic<bool> sd_mounted(false);
+int storage_error = -1; // StringId shown on screen once storage init is done, -1 for none
+bool storage_loaded = false; // Card list, usage table and analytics handed over, see takeStorageResult()
+bool storage_inline = false; // storageInitTask() runs from setup(), the task could not start
+// Written by storageInitTask() before it gives storage_ready
+bool storage_task_mounted = false;
+int storage_task_error = -1;
+
+// Runtime state of a slot, its relay pin is SLOTS[i].relay_pin
 struct Relay {
-  int pin;
   bool state;
   unsigned long timer;
 };
 
+// Access policy carried by every card, 12 bytes so it fits the index record
+struct CardPolicy {
+  uint8_t slot_mask;        // Bit i allows relays[i]
+  uint8_t flags;            // CARD_BLOCKED
+  uint16_t daily_quota;     // Minutes per day, 0 for unlimited
+  uint32_t expiry_day;      // Days since 1970-01-01, 0 for never
+  uint8_t reserved[4];
+};
+
+const CardPolicy DEFAULT_POLICY = {0xFF, 0, 0, 0, {0, 0, 0, 0}};
+
+enum PolicyResult {
+  POLICY_OK,
+  POLICY_BLOCKED,
+  POLICY_EXPIRED,
+  POLICY_QUOTA_USED
+};
+
 struct Card {
   char uid[MAX_UID_LEN];
   char name[MAX_NAME_LEN];
+  CardPolicy policy;
 };
 
 Card cardList[MAX_CARDS]; // Array to store card data
 int cardCount = 0;
 
-Relay relays[] = {
-  {RELAY_1, false, 0}, // Charger 1
-  {RELAY_2, false, 0}, // Charger 2
-  {RELAY_3, false, 0}, // Battery
-  {RELAY_4, false, 0}  // Own Charger
-  // {RELAY_5, false, 0}, // Door Lock (Integrated in battery charger)
+// One record of the sorted card index, block aligned
+struct CardRecord {
+  char uid[MAX_UID_LEN];
+  CardPolicy policy;
+};
+
+static_assert(sizeof(CardRecord) == CARD_RECORD_SIZE, "CardRecord must match the index file layout");
+
+struct CardCacheBlock {
+  int32_t block;       // Block number, -1 when empty
+  uint32_t last_used;
+  CardRecord records[CARD_RECORDS_PER_BLOCK];
+};
+
+struct CardIndex {
+  bool available;
+  File file;
+  uint32_t record_count;
+  uint32_t block_count;
+
+  // Bloom filter in front of the SD index
+  uint8_t *bloom;
+  uint32_t bloom_bits;
+  int bloom_hashes;
+
+  // Sparse fence keys narrow the binary search before touching the card
+  char fence[CARD_FENCE_MAX][MAX_UID_LEN];
+  uint32_t fence_count;
+  uint32_t fence_stride;
+
+  CardCacheBlock cache[CARD_CACHE_BLOCKS];
+  uint32_t cache_clock;
+
+  // Lookup statistics
+  uint32_t lookups;
+  uint32_t bloom_rejects;
+  uint32_t sd_reads;
+  uint32_t max_sd_reads;
+  uint32_t lookup_us_hist[16]; // Power of two buckets of lookup time
 };
 
-const int relays_count = sizeof(relays) / sizeof(relays[0]);
+CardIndex card_index;
+
+// Minutes charged today per card, checkpointed to SD
+struct UsageEntry {
+  char uid[MAX_UID_LEN];
+  uint16_t day;             // Local day number the minutes belong to, or USAGE_UPTIME_DAY | days since boot
+  uint16_t minutes;
+};
 
-const char* menu_items[] = {
-  "Charger 60V",
-  "Charger 72V",
-  "Slot Charger",
-  "Charger Baterai"
+struct UsageTable {
+  uint32_t magic;
+  UsageEntry entries[USAGE_TABLE_SIZE];
 };
 
-String current_uid = "";
+UsageTable usage_table;
+bool usage_dirty = false;
+unsigned long usage_checkpoint_timer = 0;
+
+CardPolicy current_policy = DEFAULT_POLICY; // Policy of the last registered card
+PolicyResult current_policy_result = POLICY_OK;
+
+Relay relays[SLOT_COUNT] = {};
+
+const int relays_count = SLOT_COUNT;
+
+// Screen geometry limits: four menu rows fit the display, and each row has a bit in menu_rows
+static_assert(SLOT_COUNT <= 4, "charger menu shows at most four slots");
+
+// Slot names fill the %s of the confirm dialogs, laid out for string_max_arg glyphs
+constexpr size_t nameLength(const char *name) {
+  return *name == '\0' ? 0 : 1 + nameLength(name + 1);
+}
+
+constexpr bool slotNamesFit(int i = 0) {
+  return i >= SLOT_COUNT ? true
+                         : nameLength(SLOTS[i].name) <= string_max_arg[STR_CONFIRM_ENABLE] &&
+                           nameLength(SLOTS[i].name) <= string_max_arg[STR_CONFIRM_DISABLE] && slotNamesFit(i + 1);
+}
+
+static_assert(slotNamesFit(), "slot name longer than the confirm dialogs' max_arg in lang/strings.csv");
+
+// Countdown text as last drawn, per slot, so only changed glyphs are redrawn
+char menu_countdown[relays_count][COUNTDOWN_LEN + 1];
+char strip_countdown[relays_count][COUNTDOWN_LEN + 1];
+
+// UIDs are kept in fixed buffers so the scan path never touches the heap
+char current_uid[MAX_UID_LEN] = "";
 int current_uid_index = -1;
 
-String uid_lists[4] = {
-  "",
-  "",
-  "",
-  ""
+char uid_lists[SLOT_COUNT][MAX_UID_LEN] = {};
+
+// Heap telemetry
+// Allocation counter, incremented by the malloc wrappers below (see -Wl,--wrap in platformio.ini).
+// Only the loop task counts: the storage, telemetry and lwIP tasks on core 0
+// allocate on their own and would show up as loop() allocations.
+std::atomic<uint32_t> heap_alloc_count(0);
+TaskHandle_t loop_task = NULL; // Set at the start of setup()
+
+struct HeapStats {
+  uint32_t loop_start_allocs;   // Counter value at the start of the current loop
+  uint32_t last_loop_allocs;    // Allocations done by the previous loop pass
+  uint32_t max_loop_allocs;     // Worst loop pass since boot
+  uint32_t steady_alloc_loops;  // SCAN_WAIT passes without a scan that still allocated
+  int baseline_frag;            // Fragmentation at the first report, -1 until known
+  unsigned long report_timer;
+};
+
+HeapStats heap_stats = {0, 0, 0, 0, -1, 0};
+
+// The periodic reports, formatted all at once and sent as the UART has room
+// (a blocking printf of them would stall loop() for about a second at 9600 baud)
+struct ReportOutput {
+  char text[1024 + READER_COUNT * 80]; // About 900 bytes plus 76 per reader at their longest
+  int length;
+  int sent;
+};
+
+ReportOutput report_out = {"", 0, 0};
+
+// Set while the benchmarks or an export run: the card list echo and the
+// periodic reports wait, so they stay out of the measurements and the CSV
+bool serial_quiet = false;
+
+struct TapEntry {
+  char uid[MAX_UID_LEN];
+  unsigned long seen;        // millis() of the last read, refreshed while the card stays
+};
+
+struct TapCache {
+  TapEntry entries[TAP_CACHE_SIZE];
+  uint32_t taps;             // Reads passed on to the scan flow
+  uint32_t suppressed;       // Repeat reads dropped inside the TTL
+};
+
+TapCache tap_cache;
+
+struct IdleStats {
+  unsigned long activity_timer; // Last button, door or page activity
+  bool dimmed;
+  uint64_t asleep_us;           // Light sleep time since the last report
+  uint32_t timer_wakes;
+  uint32_t gpio_wakes;
+  uint32_t uart_wakes;
+  unsigned long report_start;
+};
+
+IdleStats idle = {0, false, 0, 0, 0, 0, 0};
+
+struct TelemetryLine {
+  char text[TELEMETRY_LINE_LEN];
+  bool keep;                      // Kept in the SD backlog while offline; snapshots are not
+};
+
+// Counted on both cores: updated under TelemetryState::mux, and swapped out
+// and reset by each report
+struct TelemetryCounters {
+  uint32_t queued;
+  uint32_t dropped;               // Lost: queue full, backlog full or no SD card
+  uint32_t spilled;               // Lines written to the SD backlog
+  uint32_t spill_writes;          // SD appends, one per offline batch
+  uint32_t drained;               // Backlog lines published
+  uint32_t published;             // All lines published, backlog included
+  uint32_t batches;
+  uint32_t publish_bytes;
+  uint32_t lost_bytes;            // Backlog gone from the file: cut short by a power loss or an SD error
+};
+
+// loop() only formats lines and queues them. The telemetry task (core 0)
+// owns WiFi, MQTT and the SD backlog, so neither a slow connect nor an SD
+// write stalls loop().
+struct TelemetryState {
+  QueueHandle_t queue;
+  volatile bool online;           // MQTT connected, set by the task
+  unsigned long snapshot_timer;
+  unsigned long report_start;
+  portMUX_TYPE mux;
+  TelemetryCounters counters;
+  uint32_t backlog_bytes;         // Not yet published, under mux
+};
+
+TelemetryState telemetry = {NULL, false, 0, 0, portMUX_INITIALIZER_UNLOCKED, {}, 0};
+
+struct SlotStats {
+  uint32_t sessions;
+  uint32_t seconds;
+  uint32_t hour_seconds[24];      // Occupancy by local hour of day, needs a valid clock
 };
 
+struct CardStats {
+  char uid[MAX_UID_LEN];          // Empty for a free entry
+  uint32_t sessions;
+  uint32_t seconds;
+  uint32_t last_use;              // Epoch of the last session end, 0 while the clock is unset
+  uint32_t last_seq;              // Session number of the last use, for eviction
+  uint16_t slot_sessions[SLOT_COUNT];
+};
+
+// One journal record per finished session
+struct SessionRecord {
+  char uid[MAX_UID_LEN];
+  uint32_t seq;
+  uint32_t end;                   // Epoch, 0 while the clock is unset
+  uint32_t seconds;
+  uint8_t slot;
+  uint8_t reserved[3];
+};
+
+struct AnalyticsHeader {
+  uint32_t magic;
+  uint32_t seq;                   // Last session folded into the snapshot
+  uint16_t slot_count;
+  uint16_t card_count;
+};
+
+struct Analytics {
+  AnalyticsHeader header;
+  SlotStats slots[SLOT_COUNT];
+  CardStats cards[ANALYTICS_CARDS];
+};
+
+Analytics analytics;
+uint32_t analytics_seq = 0;       // Last session number handed out
+int journal_records = 0;
+unsigned long analytics_compact_timer = 0;
+
+// Serial commands and the CSV export they start
+enum ExportKind {
+  EXPORT_NONE,
+  EXPORT_CARDS,
+  EXPORT_SLOTS
+};
+
+struct SerialCommand {
+  char line[COMMAND_LEN];
+  int length;
+  ExportKind export_kind;
+  int export_index;               // Next row, -1 for the header
+  char row[256];                  // Row being written
+  int row_length;
+  int row_sent;
+  unsigned long rx_timer;         // Last byte received, holds off light sleep
+};
+
+SerialCommand command = {"", 0, EXPORT_NONE, 0, "", 0, 0, 0};
+
 int menu_index = 0;
 Pages current_page = SCAN_WAIT;
-const int menu_items_size = sizeof(menu_items) / sizeof(menu_items[0]);
+const int menu_items_size = SLOT_COUNT;
 
+bool readLine(File &file, char *line, size_t size);
 void loadCardList();
+bool loadCardIndex();
+bool findCardRecord(const char *uid, CardRecord *out);
+void reportCardLookupStats();
+
+bool parseCardPolicy(char *fields, CardPolicy *policy);
+uint16_t currentDay();
+bool isClockValid();
+PolicyResult checkCardPolicy(const char *uid, const CardPolicy &policy);
+bool isSlotAllowed(int slot);
+void addCardUsage(const char *uid, unsigned long elapsed_ms);
+void loadUsageTable();
+void checkpointUsageTable();
+
+void updateHeapStats(bool is_steady_state);
+void reportf(const char *format, ...);
+void reportHeapStats();
+
+void reportLastStall();
+void updateStallRecord();
+
+void bootStepStart(BootStep step);
+void bootStepEnd(BootStep step, bool ok);
+void storageInitTask(void *param);
+void storageYield();
+bool takeStorageResult(TickType_t wait);
+void reportBootTimings();
 
 bool isCardScanned();
-bool isUID_UsingCharger(String current_uid);
-bool isUID_Registered(String current_uid);
+bool isRepeatTap(const char *uid);
+void reportTapStats();
+
+void initBacklight();
+void setBacklight(uint8_t level);
+void markActivity();
+void idleSleep();
+void reportIdleStats();
+
+void costEnd();
+
+void telemetryBegin();
+void telemetryEvent(const char *type, int slot, const char *uid, long value);
+void telemetryStep();
+void reportTelemetryStats();
+
+void runBenchmarks();
+
+void endSession(int slot);
+void recordSession(int slot, const char *uid, unsigned long elapsed_ms);
+void loadAnalytics();
+void compactAnalytics();
+void serialCommandStep();
+
+void formatUID(const MFRC522::Uid &uid, char *out, size_t out_len);
+bool isUID_UsingCharger(const char *current_uid);
+bool isUID_Registered(const char *current_uid);
 bool isSlotAvailable();
 bool isBatteryChargerAvailable();
-
+bool isDoorSlotOn();
+
+int drawText(StringId id, int x, int y, TextAlign align, const char *arg = NULL);
+int textBlockHeight(StringId id);
+void drawScreenText(int screen, int only_id, const char *arg);
+void drawScreen(int screen, const char *arg = NULL);
+bool requestImage(int screen, const char *name, int arg_id = -1, const char *arg = NULL);
+void requestClear();
+void renderStep();
+bool renderSlice();
+void reportRenderStats();
+void goToScanWait();
+void drawChargerRow(int i);
+void drawRowCountdown(int i);
+void drawStatusStrip();
+void tickCountdown();
+void formatCountdown(int slot, char *out, const char *idle);
+void drawChangedGlyphs(int x, int y, const char *text, char *drawn, uint16_t fg, uint16_t bg);
+
+void displaySplash();
 void displayScanWaitMenu();
-void displayScanOK_Menu(String current_uid);
+void displayScanOK_Menu(const char *current_uid);
 void displayUnauthorizedCard();
 void displayChargerList();
 void displayChargerEnableConf();
@@ -135,10 +876,25 @@ void displayChargerDisableConf();
 void displayChargerDisableSuccess();
 void displayLogoutMenu();
 void displayChargerFull();
+void displayCardDenied();
 
 void setup() {
+  loop_task = xTaskGetCurrentTaskHandle();
+
+  // Relays go to a safe state first, whatever the previous run left behind
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    pinMode(SLOTS[i].relay_pin, OUTPUT);
+    digitalWrite(SLOTS[i].relay_pin, LOW);
+  }
+  if (HAS_DOOR_LOCK) {
+    pinMode(DOOR_LOCK_PIN, OUTPUT);
+    digitalWrite(DOOR_LOCK_PIN, LOW);
+  }
+
   Serial.begin(9600);
 
+  reportLastStall();
+
   // For safety purpose
   digitalWrite(TFT_CS, HIGH);
 
@@ -148,13 +904,6 @@ void setup() {
   pinMode(BUTTON_R, INPUT_PULLUP);
   pinMode(DOOR_SENSOR, INPUT_PULLUP);
 
-  // The relays for controlling chargers and door lock
-  pinMode(RELAY_1, OUTPUT);
-  pinMode(RELAY_2, OUTPUT);
-  pinMode(RELAY_3, OUTPUT);
-  pinMode(RELAY_4, OUTPUT);
-  pinMode(RELAY_5, OUTPUT);
-
   // Debounce init
   l_button.attach(BUTTON_L, INPUT_PULLUP);
   c_button.attach(BUTTON_C, INPUT_PULLUP);
@@ -167,68 +916,165 @@ void setup() {
   r_button.interval(25);
   door_sensor.interval(100);
 
+  // Loop stall watchdog, a hung peripheral call resets the board
+  esp_task_wdt_init(LOOP_WDT_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+
   // TFT display init
-  tft.init();
-  tft.setRotation(3); // Set rotation, 1 for landscape
-  tft.fillScreen(BG_COLOR);
+  // Runs before the storage task: TFT and SD share the VSPI bus and the bus
+  // must not be (re)started while the other side is transferring
+  bootStepStart(BOOT_TFT);
+  {
+    PeripheralScope scope(PERIPH_TFT);
+    tft.init();
+    tft.setRotation(3); // Set rotation, 1 for landscape
+    initBacklight();
+  }
+  bootStepEnd(BOOT_TFT, true);
 
-  // SD Card init
-  if (!SD.begin(SD_CS)) {
-    Serial.println("Card Mount Failed");
-    tft.setCursor(10, 10);
-    tft.setTextColor(TFT_WHITE);
-    tft.setTextSize(1);
-    tft.println("Card Mount Failed");
-    return;
+  // SD mount and card loading run on core 0 while this core draws the
+  // splash and brings up the reader. The SD bus is started here first:
+  // starting it from core 0 would reconfigure VSPI under the splash transfer.
+  {
+    PeripheralScope scope(PERIPH_SD);
+    vspi.begin();
+  }
+  storage_ready = xSemaphoreCreateBinary();
+  if (xTaskCreatePinnedToCore(storageInitTask, "storage_init", 8192, (void *)1, 1, NULL, 0) != pdPASS) {
+    storage_inline = true;
+    storageInitTask(NULL);
+  }
+
+  bootStepStart(BOOT_SPLASH);
+  displaySplash();
+  bootStepEnd(BOOT_SPLASH, true);
+
+  // RFID init, independent of the SD card
+  bootStepStart(BOOT_RFID);
+  {
+    PeripheralScope scope(PERIPH_RFID);
+    hspi.begin(RFID_SCK, RFID_MISO, RFID_MOSI, RFID_SS);
+    // Deselect every reader before the first one talks on the bus
+    for (int i = 0; i < READER_COUNT; i++) {
+      pinMode(READERS[i].ss_pin, OUTPUT);
+      digitalWrite(READERS[i].ss_pin, HIGH);
+    }
+    SPI = hspi;
+    for (int i = 0; i < READER_COUNT; i++) {
+      mfrc522[i].PCD_Init(READERS[i].ss_pin, READERS[i].rst_pin);
+      readers[i].interval = READER_POLL_MIN;
+    }
+  }
+  bootStepEnd(BOOT_RFID, true);
+
+  // Wait for the card list, feeding the watchdog meanwhile
+  unsigned long wait_start = millis();
+  while (!takeStorageResult(pdMS_TO_TICKS(1000))) {
+    esp_task_wdt_reset();
+    if (millis() - wait_start > BOOT_STORAGE_TIMEOUT) {
+      storage_error = STR_SD_TIMEOUT;
+      break;
+    }
   }
 
-  Serial.println("SD Card initialized successfully.");
+  if (storage_error >= 0) {
+    PeripheralScope scope(PERIPH_TFT);
+    tft.setTextColor(TFT_RED, BG_COLOR);
+    drawText((StringId)storage_error, 10, 10, ALIGN_LEFT);
+  }
 
-  loadCardList();
+  reportBootTimings();
+  telemetryBegin();
 
-  // RFID init
-  hspi.begin(RFID_SCK, RFID_MISO, RFID_MOSI, RFID_SS);
-  pinMode(RFID_SS, OUTPUT);
-  SPI = hspi;
-  mfrc522.PCD_Init();
+#if STATION_BENCH
+  runBenchmarks();
+#endif
 
   // displayChargerList();
+
+  // Boot allocations are not the first loop() pass's
+  heap_stats.loop_start_allocs = heap_alloc_count.load(std::memory_order_relaxed);
 }
 
 // The loop function is responsible for updating button states and managing the flow of a menu-driven interface based on the current page, handling various states such as waiting for a scan, choosing a charger, and confirming charger enable/disable actions. It includes logic for button presses to navigate and select options within the menu.
 void loop() {
+  // The previous pass was steady state if it sat in SCAN_WAIT without a scan
+  static bool was_steady_state = false;
+  updateHeapStats(was_steady_state);
+  was_steady_state = (current_page == SCAN_WAIT);
+
+  esp_task_wdt_reset();
+  updateStallRecord();
+
+  // A storage task that outlived the boot timeout hands over its results here
+  if (!storage_loaded && takeStorageResult(0)) {
+    Serial.println("Storage ready after boot timeout");
+    isScanWaitShow = false; // Redraw the scan screen without the timeout message
+  }
+
   // Control goes here
   for (int i = 0; i < relays_count; i++) {
     if (relays[i].state && millis() - relays[i].timer > RELAY_ON_TIME) {
       relays[i].state = false;
-      digitalWrite(relays[i].pin, LOW);
-      uid_lists[i] = "";
+      digitalWrite(SLOTS[i].relay_pin, LOW);
+      endSession(i);
+      uid_lists[i][0] = '\0';
       if (current_page == CHOOSE_CHARGER) {
-        last_menu_index = -1;
-        displayChargerList();
+        render.menu_rows |= 1 << i;
+        render.dirty |= DIRTY_MENU_ROWS;
       }
     }
   }
 
+  if (usage_dirty && millis() - usage_checkpoint_timer > USAGE_CHECKPOINT_INTERVAL) {
+    checkpointUsageTable();
+  }
+
+  if (journal_records >= ANALYTICS_COMPACT_RECORDS ||
+      (journal_records > 0 && millis() - analytics_compact_timer > ANALYTICS_COMPACT_INTERVAL)) {
+    compactAnalytics();
+  }
+
+  telemetryStep();
+  serialCommandStep();
+
   l_button.update();
   c_button.update();
   r_button.update();
   door_sensor.update();
 
+  if (l_button.changed() || c_button.changed() || r_button.changed() || door_sensor.changed() ||
+      current_page != SCAN_WAIT) {
+    markActivity();
+  }
+
+  // Draw what the previous pass requested, within the frame budget
+  renderStep();
+
   switch (current_page)
   {
   case SCAN_WAIT:
     // Waiting for Scan Menu
+    if (c_button.fell()) {
+      current_language = (Language)((current_language + 1) % LANG_COUNT);
+      isScanWaitShow = false;
+    }
+
     displayScanWaitMenu();
 
     if (isCardScanned()) {
-      current_uid = "";
-      for (byte i = 0; i < mfrc522.uid.size; i++) {
-        current_uid += String(mfrc522.uid.uidByte[i], HEX);
-      }
-      Serial.println("Scanned UID: " + current_uid);
-
-      if (!isUID_Registered(current_uid)) {
+      was_steady_state = false;
+      formatUID(mfrc522[scanned_reader].uid, current_uid, sizeof(current_uid));
+      current_bay = READERS[scanned_reader].slot;
+      Serial.print("Scanned UID: ");
+      Serial.print(current_uid);
+      Serial.print(" | Reader: ");
+      Serial.println(scanned_reader);
+
+      bool registered = isUID_Registered(current_uid);
+      telemetryEvent(registered ? "scan" : "unknown", current_bay, current_uid, 0);
+
+      if (!registered) {
         current_page = UNAUTHORIZED_CARD;
         loading_timer = millis();
         isScanWaitShow = false;
@@ -239,16 +1085,18 @@ void loop() {
         isScanWaitShow = false;
         displayScanOK_Menu(current_uid);
       }
+    } else {
+      idleSleep();
     }
 
     break;
   
   case UNAUTHORIZED_CARD:
+  case CARD_DENIED:
     if (millis() - loading_timer <= LOADING_SCREEN_TIMEOUT) {
       return;
     } else {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
     break;
 
@@ -261,6 +1109,12 @@ void loop() {
       current_page = CHARGER_DISABLE_CONF;
       displayChargerDisableConf();
 
+    } else if ((current_policy_result = checkCardPolicy(current_uid, current_policy)) != POLICY_OK) {
+      telemetryEvent("denied", -1, current_uid, current_policy_result);
+      current_page = CARD_DENIED;
+      loading_timer = millis();
+      displayCardDenied();
+
     } else if (!isSlotAvailable()) {
       current_page = CHARGER_FULL;
       displayChargerFull();
@@ -268,7 +1122,12 @@ void loop() {
 
     } else {
       current_page = CHOOSE_CHARGER;
-      menu_index = 0;
+      // Card read at a bay reader: start on that bay's slot
+      if (current_bay >= 0 && !relays[current_bay].state && isSlotAllowed(current_bay)) {
+        menu_index = current_bay;
+      } else {
+        menu_index = 0;
+      }
 
     }
 
@@ -291,7 +1150,7 @@ void loop() {
     if (c_button.fell()) {
       Serial.println("C Button Pressed");
 
-      if (relays[menu_index].state == false) {
+      if (relays[menu_index].state == false && isSlotAllowed(menu_index)) {
         current_page = CHARGER_ENABLE_CONF;
         displayChargerEnableConf();
       }
@@ -334,8 +1193,7 @@ void loop() {
   case CHARGER_ENABLE_CONF:
     // Cancel
     if (r_button.fell()) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
       last_menu_index = -1;
     }
 
@@ -344,16 +1202,17 @@ void loop() {
       relays[menu_index].state = true;
       relays[menu_index].timer = millis();
 
-      digitalWrite(relays[menu_index].pin, relays[menu_index].state);
+      digitalWrite(SLOTS[menu_index].relay_pin, relays[menu_index].state);
 
-      uid_lists[menu_index] = current_uid;
+      strncpy(uid_lists[menu_index], current_uid, MAX_UID_LEN);
+      telemetryEvent("start", menu_index, current_uid, 0);
       last_menu_index = -1;
 
-      if (menu_index == 3) {
+      if (HAS_DOOR_LOCK && menu_index == DOOR_LOCK_SLOT) {
         current_page = DOOR_LOCK;
         displayDoorLockWaitMenu();
         delay(100);
-        digitalWrite(RELAY_5, HIGH);
+        digitalWrite(DOOR_LOCK_PIN, HIGH);
 
       } else {
         current_page = CHARGER_ENABLE_SUCCESS;
@@ -366,47 +1225,45 @@ void loop() {
   case DOOR_LOCK:
 
     if (door_sensor.fell()) {
-      digitalWrite(RELAY_5, LOW);
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      digitalWrite(DOOR_LOCK_PIN, LOW);
+      goToScanWait();
     }  
 
     break;
   
   case CHARGER_ENABLE_SUCCESS:
     if (millis() - warning_timer > WARNING_TIMEOUT) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
 
     if (l_button.fell() || c_button.fell() || r_button.fell()) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
 
     break;
 
   case CHARGER_DISABLE_CONF:
     if (r_button.fell()) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
       last_menu_index = -1;
     }
 
     if (l_button.fell()) {
       relays[current_uid_index].state = false;
+      endSession(current_uid_index);
 
-      digitalWrite(relays[current_uid_index].pin, relays[current_uid_index].state);
+      digitalWrite(SLOTS[current_uid_index].relay_pin, relays[current_uid_index].state);
 
-      uid_lists[current_uid_index] = "";
+      uid_lists[current_uid_index][0] = '\0';
       last_menu_index = -1;
 
-      if (menu_index == 3) {
+      // The slot being released is the card's own, menu_index is stale here
+      if (HAS_DOOR_LOCK && current_uid_index == DOOR_LOCK_SLOT) {
         current_page = DOOR_LOCK;
         displayDoorLockWaitMenu();
         delay(100);
-        digitalWrite(RELAY_5, HIGH);
-        
+        digitalWrite(DOOR_LOCK_PIN, HIGH);
+
       } else {
         current_page = CHARGER_DISABLE_SUCCESS;
         warning_timer = millis();
@@ -418,25 +1275,21 @@ void loop() {
   
   case CHARGER_DISABLE_SUCCESS:
     if (millis() - warning_timer > WARNING_TIMEOUT) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
 
     if (l_button.fell() || c_button.fell() || r_button.fell()) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
     break;
   
   case CHARGER_FULL:
     if (millis() - warning_timer > WARNING_TIMEOUT) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
 
     if (l_button.fell() || c_button.fell() || r_button.fell()) {
-      current_page = SCAN_WAIT;
-      tft.fillScreen(BG_COLOR);
+      goToScanWait();
     }
 
     break;
@@ -446,50 +1299,181 @@ void loop() {
   }
 }
 
+// Reads one line without its line ending. A line that does not fit is
+// consumed up to its end and reported by returning false.
+bool readLine(File &file, char *line, size_t size) {
+  size_t len = 0;
+  bool fits = true;
+
+  while (file.available()) {
+    int c = file.read();
+    if (c == '\n') break;
+    if (c == '\r') continue;
+    if (len < size - 1) {
+      line[len++] = (char)c;
+    } else {
+      fits = false;
+    }
+  }
+
+  line[len] = '\0';
+  return fits;
+}
+
 void loadCardList() {
+  PeripheralScope scope(PERIPH_SD);
   File file = SD.open("/card_list.csv");
   if (!file) {
     Serial.println("Failed to open card_list.csv");
-    tft.setCursor(10, 10);
-    tft.setTextColor(TFT_WHITE);
-    tft.setTextSize(1);
-    tft.println("Gagal membuka card_list.csv");
+    storage_task_error = STR_CARD_LIST_FAILED; // Runs on the storage task, see takeStorageResult()
     return;
   }
 
-  Serial.println("Loading card list...");
-  int y = 10; // Initial TFT cursor position
+  if (!serial_quiet) Serial.println("Loading card list...");
+
+  char line[CARD_LINE_LEN];
 
   while (file.available() && cardCount < MAX_CARDS) {
-    String line = file.readStringUntil('\n'); // Read one line
+    if (!readLine(file, line, sizeof(line))) {
+      // Cut short it would load as a different UID or a truncated policy
+      Serial.printf("Skipping card_list.csv line over %u characters\n", (unsigned)(sizeof(line) - 1));
+      continue;
+    }
+
+    char *comma = strchr(line, ','); // Find the comma separator
+    if (comma == NULL) continue; // Skip invalid lines
+    *comma = '\0';
 
-    int commaIndex = line.indexOf(','); // Find the comma separator
-    if (commaIndex == -1) continue; // Skip invalid lines
+    const char *uid = line;
+    char *name = comma + 1;
 
-    String uid = line.substring(0, commaIndex);
-    String name = line.substring(commaIndex + 1);
+    // Optional policy columns after the name: slots,quota,expiry,blocked
+    cardList[cardCount].policy = DEFAULT_POLICY;
+    char *policy_fields = strchr(name, ',');
+    if (policy_fields != NULL) {
+      *policy_fields = '\0';
+      if (!parseCardPolicy(policy_fields + 1, &cardList[cardCount].policy)) {
+        Serial.print("Invalid policy for UID: "); Serial.println(uid);
+      }
+    }
 
     // Store in the array
-    uid.toCharArray(cardList[cardCount].uid, MAX_UID_LEN);
-    name.toCharArray(cardList[cardCount].name, MAX_NAME_LEN);
+    strncpy(cardList[cardCount].uid, uid, MAX_UID_LEN - 1);
+    cardList[cardCount].uid[MAX_UID_LEN - 1] = '\0';
+    strncpy(cardList[cardCount].name, name, MAX_NAME_LEN - 1);
+    cardList[cardCount].name[MAX_NAME_LEN - 1] = '\0';
     cardCount++;
 
     // Print to Serial Monitor
-    Serial.print("UID: "); Serial.print(uid);
-    Serial.print(" | Name: "); Serial.println(name);
+    if (!serial_quiet) {
+      Serial.print("UID: "); Serial.print(uid);
+      Serial.print(" | Name: "); Serial.println(name);
+    }
   }
 
   file.close();
-  Serial.println("Card list loaded.");
+  if (!serial_quiet) Serial.println("Card list loaded.");
 }
 
+// Polls at most one reader per call: the next due one in round-robin order
 bool isCardScanned() {
-  return mfrc522.PICC_IsNewCardPresent() && mfrc522.PICC_ReadCardSerial(); 
+  unsigned long now = millis();
+  int r = -1;
+
+  for (int n = 0; n < READER_COUNT; n++) {
+    int candidate = (next_reader + n) % READER_COUNT;
+    if (now - readers[candidate].next_poll < 0x80000000UL) { // Due, wrap-safe
+      r = candidate;
+      break;
+    }
+  }
+  if (r < 0) return false;
+
+  next_reader = (r + 1) % READER_COUNT;
+  ReaderState &state = readers[r];
+  MFRC522 &reader = mfrc522[r];
+  state.polls++;
+
+  PeripheralScope scope(PERIPH_RFID);
+  if (!reader.PICC_IsNewCardPresent() || !reader.PICC_ReadCardSerial()) {
+    state.interval = state.interval * 2 < READER_POLL_MAX ? state.interval * 2 : READER_POLL_MAX;
+    state.next_poll = now + state.interval;
+    return false;
+  }
+
+  state.reads++;
+  state.interval = READER_POLL_MIN;
+  state.next_poll = now + state.interval;
+
+  // Halt the card so it stays quiet until it leaves the field
+  reader.PICC_HaltA();
+  reader.PCD_StopCrypto1();
+
+  char uid[MAX_UID_LEN];
+  formatUID(reader.uid, uid, sizeof(uid));
+  if (isRepeatTap(uid)) {
+    tap_cache.suppressed++;
+    return false;
+  }
+
+  tap_cache.taps++;
+  scanned_reader = r;
+  return true;
+}
+
+// Checks the UID against the recently seen cards and records it
+bool isRepeatTap(const char *uid) {
+  unsigned long now = millis();
+  int oldest = 0;
+  unsigned long oldest_age = 0;
+
+  for (int i = 0; i < TAP_CACHE_SIZE; i++) {
+    TapEntry &entry = tap_cache.entries[i];
+    if (entry.uid[0] != '\0' && strcmp(entry.uid, uid) == 0) {
+      bool repeat = now - entry.seen < TAP_SUPPRESS_TTL;
+      entry.seen = now;
+      return repeat;
+    }
+
+    // Empty slots are reused first
+    unsigned long age = entry.uid[0] == '\0' ? ~0UL : now - entry.seen;
+    if (age >= oldest_age) {
+      oldest = i;
+      oldest_age = age;
+    }
+  }
+
+  strncpy(tap_cache.entries[oldest].uid, uid, MAX_UID_LEN - 1);
+  tap_cache.entries[oldest].uid[MAX_UID_LEN - 1] = '\0';
+  tap_cache.entries[oldest].seen = now;
+  return false;
 }
 
-bool isUID_UsingCharger(String current_uid) {
-  for (int i = 0; i < 4; i++) {
-      if (current_uid == uid_lists[i]) {
+void reportTapStats() {
+  reportf("[rfid] taps=%u suppressed=%u ttl=%lu ms\n",
+    (unsigned)tap_cache.taps, (unsigned)tap_cache.suppressed, TAP_SUPPRESS_TTL);
+
+  for (int i = 0; i < READER_COUNT; i++) {
+    reportf("[rfid] reader=%d slot=%d polls=%u reads=%u interval=%lu ms\n",
+      i, READERS[i].slot, (unsigned)readers[i].polls, (unsigned)readers[i].reads, readers[i].interval);
+  }
+}
+
+// Same digits as the old String(byte, HEX) concatenation: lowercase, no zero padding
+void formatUID(const MFRC522::Uid &uid, char *out, size_t out_len) {
+  size_t pos = 0;
+  out[0] = '\0';
+
+  for (byte i = 0; i < uid.size && pos < out_len; i++) {
+    int written = snprintf(out + pos, out_len - pos, "%x", uid.uidByte[i]);
+    if (written < 0) break;
+    pos += written;
+  }
+}
+
+bool isUID_UsingCharger(const char *current_uid) {
+  for (int i = 0; i < SLOT_COUNT; i++) {
+      if (uid_lists[i][0] != '\0' && strcmp(current_uid, uid_lists[i]) == 0) {
           current_uid_index = i;
           return true; // Found in the list
       }
@@ -497,9 +1481,19 @@ bool isUID_UsingCharger(String current_uid) {
   return false; // Not found
 }
 
-bool isUID_Registered(String current_uid) {
+bool isUID_Registered(const char *current_uid) {
+  if (!storage_loaded) return false; // Still loading after a boot timeout
+
+  if (card_index.available) {
+    CardRecord record;
+    if (!findCardRecord(current_uid, &record)) return false;
+    current_policy = record.policy;
+    return true;
+  }
+
   for (int i = 0; i < cardCount; i++) {
-    if (current_uid == cardList[i].uid) {
+    if (strcmp(current_uid, cardList[i].uid) == 0) {
+      current_policy = cardList[i].policy;
       return true;
     }
   }
@@ -507,8 +1501,8 @@ bool isUID_Registered(String current_uid) {
 }
 
 bool isSlotAvailable() {
-  for (int i = 0; i < 4; i++) {
-    if (uid_lists[i] == "") {
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    if (uid_lists[i][0] == '\0' && isSlotAllowed(i)) {
         current_uid_index = i;
         return true; 
     }
@@ -517,61 +1511,292 @@ bool isSlotAvailable() {
 }
 
 bool isBatteryChargerAvailable() {
-  
+  return HAS_DOOR_LOCK && !isDoorSlotOn() && uid_lists[HAS_DOOR_LOCK ? DOOR_LOCK_SLOT : 0][0] == '\0';
 }
 
-void displayScanWaitMenu() {
-  // Text properties
-  int y_offset = tft.height() / 2 - 20;
-
-  if (!isScanWaitShow) {
-    tft.fillScreen(BG_COLOR);
-    tft.setTextSize(2);
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-    tft.drawString("Scan Kartu Anda", tft.width() / 2, y_offset);
-    tft.drawString("untuk Mulai", tft.width() / 2, y_offset + 30);
+// State of the slot behind the door lock, false on boards without one
+bool isDoorSlotOn() {
+  return HAS_DOOR_LOCK && relays[HAS_DOOR_LOCK ? DOOR_LOCK_SLOT : 0].state;
+}
 
-    isScanWaitShow = true;
-  }
+void displaySplash() {
+  PeripheralScope scope(PERIPH_TFT);
+  tft.fillScreen(BG_COLOR);
+  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
+  drawText(STR_SPLASH, tft.width() / 2, (tft.height() - textBlockHeight(STR_SPLASH)) / 2, ALIGN_CENTER);
+}
 
-  // Variables for animation
-  static unsigned long previousMillis = 0;
-  static int animationStep = 0;
-  const int animationDelay = 500; // Milliseconds per step
+// Draws a catalog string with its build-time layout and returns the y below it.
+// Colors are left to the caller; x is the left edge or the center line.
+int drawText(StringId id, int x, int y, TextAlign align, const char *arg) {
+  const TextLayout &layout = string_table[current_language][id];
+  int glyph_width = GLYPH_WIDTH * layout.text_size;
+  int line_height = 10 * layout.text_size;
 
-  unsigned long currentMillis = millis();
+  tft.setTextSize(layout.text_size);
 
-  // Check if it's time to update animation
-  if (currentMillis - previousMillis >= animationDelay) {
-    previousMillis = currentMillis;
+  for (int i = 0; i < layout.line_count; i++) {
+    const TextLine &line = layout.lines[i];
+    int width = line.width;
+    if (line.has_arg && arg != NULL) {
+      width += strlen(arg) * glyph_width;
+    }
 
-    // Clear previous dots
-    for (int i = 0; i < 3; i++) {
-      tft.fillCircle(tft.width() / 2 - 20 + (i * 20), y_offset + 100, 5, TFT_BLACK);
+    tft.setCursor(align == ALIGN_CENTER ? x - width / 2 : x, y + i * line_height);
+    if (line.has_arg) {
+      tft.printf(line.text, arg != NULL ? arg : "");
+    } else {
+      tft.print(line.text);
     }
+  }
 
-    // Draw new animation step
-    tft.fillCircle(tft.width() / 2 - 20 + (animationStep * 20), y_offset + 100, 5, TFT_BLUE);
+  return y + layout.line_count * line_height;
+}
+
+int textBlockHeight(StringId id) {
+  const TextLayout &layout = string_table[current_language][id];
+  return layout.line_count * 10 * layout.text_size;
+}
 
-    // Cycle animation
-    animationStep = (animationStep + 1) % 3; // 0 → 1 → 2 → 3 → 0
+// Draws the text blocks of a static screen at their generated positions
+// (scripts/gen_screens.py), only those of string only_id unless it is -1
+void drawScreenText(int screen, int only_id, const char *arg) {
+  const ScreenLayout &layout = screen_layouts[current_language][screen];
+  for (int i = 0; i < layout.count; i++) {
+    const ScreenText &text = layout.texts[i];
+    if (only_id >= 0 && text.id != only_id) continue;
+    drawText(text.id, text.x, text.y, text.centered ? ALIGN_CENTER : ALIGN_LEFT, arg);
   }
 }
 
-// void displayScanWaitMenu() {
-//   tft.fillScreen(TFT_BLACK);
+// Static screen without its image: the same layout, drawn text by text
+void drawScreen(int screen, const char *arg) {
+  tft.fillScreen(BG_COLOR);
+  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
+  drawScreenText(screen, -1, arg);
+}
 
-//   // Text properties
-//   int y_offset = tft.height() / 2 - 20;
-//   tft.setTextSize(2);
-//   tft.setTextDatum(MC_DATUM);
-//   tft.setTextColor(TFT_WHITE, TFT_BLACK);
-//   tft.drawString("Scan Your Card", tft.width() / 2, y_offset);
-//   tft.drawString("to Start", tft.width() / 2, y_offset + 30);
+// Queues a pre-rendered screen, drawn band by band by the render scheduler.
+// Returns false when images are compiled out and the caller draws instead.
+bool requestImage(int screen, const char *name, int arg_id, const char *arg) {
+#if USE_SCREEN_IMAGES
+  // The image covers the whole panel, anything still pending is moot
+  render.dirty = DIRTY_IMAGE | (arg_id >= 0 ? DIRTY_IMAGE_ARG : 0);
+  render.menu_rows = 0;
+  render.band = 0;
+  render.image = screen;
+  render.image_name = name;
+  render.image_arg_id = arg_id;
+  render.image_arg = arg;
+  render.image_data = screen_images[current_language][screen].data;
+  render.image_runs = NULL;
+  render.image_run_count = 0;
+  render.image_start = micros();
+  costBegin(name);
+  return true;
+#else
+  // The caller draws synchronously, drop anything that would paint over it
+  render.dirty = 0;
+  render.menu_rows = 0;
+  (void)screen;
+  (void)name;
+  (void)arg_id;
+  (void)arg;
+  return false;
+#endif
+}
 
-//   // Variables for animation
-//   unsigned long previousMillis = 0;
+void requestClear() {
+  render.dirty = DIRTY_CLEAR;
+  render.menu_rows = 0;
+  render.band = 0;
+}
+
+void goToScanWait() {
+  current_page = SCAN_WAIT;
+  isScanWaitShow = false;
+}
+
+void renderStep() {
+  unsigned long start = micros();
+
+  // At least one slice per pass, more while the budget allows
+  while (renderSlice()) {
+    if (micros() - start >= RENDER_FRAME_BUDGET_US) break;
+  }
+
+  // A screen is complete once its queued work has drained
+  if (render.dirty == 0) costEnd();
+
+  unsigned long elapsed = micros() - start;
+  if (elapsed > render.max_frame_us) render.max_frame_us = elapsed;
+  if (elapsed > RENDER_FRAME_BUDGET_US) render.over_budget_frames++;
+}
+
+// Draws one slice of the most urgent pending work, false when nothing is left
+bool renderSlice() {
+  if (render.dirty == 0) return false;
+
+  PeripheralScope scope(PERIPH_TFT);
+
+  if (render.dirty & DIRTY_CLEAR) {
+    tft.fillRect(0, render.band * RENDER_BAND_HEIGHT, tft.width(), RENDER_BAND_HEIGHT, BG_COLOR);
+    if (++render.band * RENDER_BAND_HEIGHT >= tft.height()) {
+      render.dirty &= ~DIRTY_CLEAR;
+    }
+    return true;
+  }
+
+#if USE_SCREEN_IMAGES
+  if (render.dirty & DIRTY_IMAGE) {
+    const ScreenImage &image = screen_images[current_language][render.image];
+    const uint8_t *end = image.data + image.size;
+    int rows = RENDER_BAND_HEIGHT / SCREEN_IMAGE_SCALE;
+
+    tft.startWrite();
+    tft.setAddrWindow(0, render.band * RENDER_BAND_HEIGHT, tft.width(), RENDER_BAND_HEIGHT);
+#if RENDER_COST
+    tft.recordBlock(tft.width(), RENDER_BAND_HEIGHT);
+#endif
+
+    for (int row = 0; row < rows && render.image_data < end; row++) {
+      uint8_t count = pgm_read_byte(render.image_data++);
+      if (count != 0) { // 0 repeats the previous row
+        render.image_runs = render.image_data;
+        render.image_run_count = count;
+        render.image_data += count;
+      }
+
+      for (int repeat = 0; repeat < SCREEN_IMAGE_SCALE; repeat++) {
+        for (int i = 0; i < render.image_run_count; i++) {
+          uint32_t length = pgm_read_byte(render.image_runs + i) * SCREEN_IMAGE_SCALE;
+          if (length > 0) {
+            tft.pushBlock(i % 2 ? TXT_COLOR_1 : BG_COLOR, length);
+          }
+        }
+      }
+    }
+
+    tft.endWrite();
+
+    render.band++;
+    if (render.image_data >= end) {
+      render.dirty &= ~DIRTY_IMAGE;
+#if SCREEN_TIMING
+      Serial.printf("[screen] %s %lu us\n", render.image_name, micros() - render.image_start);
+#endif
+    }
+    return true;
+  }
+
+  if (render.dirty & DIRTY_IMAGE_ARG) {
+    tft.setTextColor(TXT_COLOR_1, BG_COLOR);
+    drawScreenText(render.image, render.image_arg_id, render.image_arg);
+    render.dirty &= ~DIRTY_IMAGE_ARG;
+    return true;
+  }
+#endif
+
+  if (render.dirty & DIRTY_SCAN_PROMPT) {
+    int y_offset = tft.height() / 2 - 20;
+    tft.setTextColor(TXT_COLOR_1, BG_COLOR);
+    drawText(STR_SCAN_PROMPT, tft.width() / 2, y_offset - 10, ALIGN_CENTER);
+    drawText(STR_LANGUAGE_HINT, tft.width() / 2, tft.height() - 20, ALIGN_CENTER);
+
+    // Keep storage problems from boot visible, the station still runs without SD
+    if (storage_error >= 0) {
+      tft.setTextColor(TFT_RED, BG_COLOR);
+      drawText((StringId)storage_error, tft.width() / 2, 10, ALIGN_CENTER);
+    }
+
+    render.dirty &= ~DIRTY_SCAN_PROMPT;
+    return true;
+  }
+
+  if (render.dirty & DIRTY_SCAN_DOTS) {
+    int y_offset = tft.height() / 2 - 20;
+
+    // Clear previous dots
+    for (int i = 0; i < 3; i++) {
+      tft.fillCircle(tft.width() / 2 - 20 + (i * 20), y_offset + 100, 5, TFT_BLACK);
+    }
+
+    // Draw new animation step
+    tft.fillCircle(tft.width() / 2 - 20 + (render.dots_step * 20), y_offset + 100, 5, TFT_BLUE);
+    render.dots_step = (render.dots_step + 1) % 3; // 0 → 1 → 2 → 0
+
+    render.dirty &= ~DIRTY_SCAN_DOTS;
+    return true;
+  }
+
+  if (render.dirty & DIRTY_MENU_ROWS) {
+    // One row per slice
+    for (int i = 0; i < menu_items_size; i++) {
+      if (render.menu_rows & (1 << i)) {
+        render.menu_rows &= ~(1 << i);
+        drawChargerRow(i);
+        break;
+      }
+    }
+    if (render.menu_rows == 0) {
+      render.dirty &= ~DIRTY_MENU_ROWS;
+    }
+    return true;
+  }
+
+  if (render.dirty & DIRTY_COUNTDOWN) {
+    if (current_page == CHOOSE_CHARGER) {
+      for (int i = 0; i < relays_count; i++) {
+        drawRowCountdown(i);
+      }
+    } else if (current_page == SCAN_WAIT) {
+      drawStatusStrip();
+    }
+
+    render.dirty &= ~DIRTY_COUNTDOWN;
+    return true;
+  }
+
+  render.dirty = 0; // Flags for work compiled out
+  return false;
+}
+
+void reportRenderStats() {
+  reportf("[render] max_frame=%lu us over_budget_frames=%u\n", render.max_frame_us, (unsigned)render.over_budget_frames);
+  render.max_frame_us = 0;
+}
+
+void displayScanWaitMenu() {
+  if (!isScanWaitShow) {
+    requestClear();
+    render.dirty |= DIRTY_SCAN_PROMPT | DIRTY_SCAN_DOTS | DIRTY_COUNTDOWN;
+    memset(strip_countdown, 0, sizeof(strip_countdown));
+    isScanWaitShow = true;
+    costBegin("scan_wait");
+  }
+
+  tickCountdown();
+
+  // The animation pauses while the backlight is dimmed
+  if (!idle.dimmed && millis() - render.dots_timer >= SCAN_DOTS_INTERVAL) {
+    render.dots_timer = millis();
+    render.dirty |= DIRTY_SCAN_DOTS;
+  }
+}
+
+// void displayScanWaitMenu() {
+//   tft.fillScreen(TFT_BLACK);
+
+//   // Text properties
+//   int y_offset = tft.height() / 2 - 20;
+//   tft.setTextSize(2);
+//   tft.setTextDatum(MC_DATUM);
+//   tft.setTextColor(TFT_WHITE, TFT_BLACK);
+//   tft.drawString("Scan Your Card", tft.width() / 2, y_offset);
+//   tft.drawString("to Start", tft.width() / 2, y_offset + 30);
+
+//   // Variables for animation
+//   unsigned long previousMillis = 0;
 //   int animationStep = 0;
 //   const int animationDelay = 500; // Milliseconds per step
 
@@ -644,121 +1869,146 @@ void displayScanWaitMenu() {
 //   tft.drawString("Card Detected!", tft.width() / 2, tft.height() / 2);
 // }
 
-void displayScanOK_Menu(String current_uid) {
-  tft.fillScreen(BG_COLOR);
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  
-  // Show "Card Detected!"
-  tft.drawString("Kartu terdeteksi!", tft.width() / 2, tft.height() / 2 - 20);
+void displayScanOK_Menu(const char *current_uid) {
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_SCAN_OK, "scan_ok", STR_UID_LINE, current_uid)) return;
 
-  // Show UID
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.drawString("UID: " + current_uid, tft.width() / 2, tft.height() / 2 + 20);
+  ScreenTimer timer("scan_ok");
+
+  drawScreen(SCREEN_SCAN_OK, current_uid);
 }
 
 void displayUnauthorizedCard() {
-  tft.fillScreen(BG_COLOR);
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.drawString("Kartu tidak terdaftar!", tft.width() / 2, tft.height() / 2);
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_UNAUTHORIZED, "unauthorized")) return;
+
+  ScreenTimer timer("unauthorized");
+
+  drawScreen(SCREEN_UNAUTHORIZED);
 }
 
 void displayChargerList() {
+  if (last_menu_index == -1) {
+    // Full repaint: background band by band, then every row
+    costBegin("charger_list");
+    requestClear();
+    render.menu_rows = (1 << menu_items_size) - 1;
+    render.dirty |= DIRTY_MENU_ROWS;
+  } else if (last_menu_index != menu_index) {
+    // Highlight moved: only the old and the new row
+    render.menu_rows |= (1 << last_menu_index) | (1 << menu_index);
+    render.dirty |= DIRTY_MENU_ROWS;
+  }
+
+  last_menu_index = menu_index;
+
+  tickCountdown();
+}
+
+void tickCountdown() {
+  if (millis() - render.countdown_timer >= 1000) {
+    render.countdown_timer = millis();
+    render.dirty |= DIRTY_COUNTDOWN;
+  }
+}
+
+// Remaining relay time as "mm:ss", or the idle text when the slot is off
+void formatCountdown(int slot, char *out, const char *idle) {
+  if (!relays[slot].state) {
+    strncpy(out, idle, COUNTDOWN_LEN + 1);
+    return;
+  }
+
+  unsigned long elapsed = millis() - relays[slot].timer;
+  unsigned long left = elapsed < RELAY_ON_TIME ? (RELAY_ON_TIME - elapsed + 999) / 1000 : 0;
+  if (left > 99 * 60 + 59) left = 99 * 60 + 59;
+  snprintf(out, COUNTDOWN_LEN + 1, "%2lu:%02lu", left / 60, left % 60);
+}
+
+// Charger menu countdown, left of the toggle; same geometry as drawChargerRow()
+void drawRowCountdown(int i) {
+  int x = 30 + 400 - 140 - COUNTDOWN_LEN * GLYPH_WIDTH * 2 - 2;
+  int y = 30 + i * 60 + 15;
+  bool is_selected = (i == menu_index);
+
+  char countdown[COUNTDOWN_LEN + 1];
+  formatCountdown(i, countdown, "     ");
+  drawChangedGlyphs(x, y, countdown, menu_countdown[i],
+    is_selected ? TFT_WHITE : TFT_BLACK, is_selected ? TFT_BLUE : TFT_LIGHTGREY);
+}
+
+// Idle status strip on the scan screen: slot number and its remaining time
+void drawStatusStrip() {
+  int cell_width = (COUNTDOWN_LEN + 3) * GLYPH_WIDTH * 2;
+  int x_start = (tft.width() - relays_count * cell_width) / 2;
+  char countdown[COUNTDOWN_LEN + 1];
+
+  for (int i = 0; i < relays_count; i++) {
+    int x = x_start + i * cell_width;
+    if (strip_countdown[i][0] == '\0') {
+      tft.drawChar(x, STATUS_STRIP_Y, '1' + i, TFT_BLUE, BG_COLOR, 2);
+    }
+    formatCountdown(i, countdown, "--:--");
+    drawChangedGlyphs(x + 2 * GLYPH_WIDTH * 2, STATUS_STRIP_Y, countdown, strip_countdown[i], TXT_COLOR_1, BG_COLOR);
+  }
+}
+
+// Redraws only the character cells that differ from what is on screen
+void drawChangedGlyphs(int x, int y, const char *text, char *drawn, uint16_t fg, uint16_t bg) {
+  for (int i = 0; i < COUNTDOWN_LEN; i++) {
+    if (text[i] != drawn[i]) {
+      tft.drawChar(x + i * GLYPH_WIDTH * 2, y, text[i], fg, bg, 2);
+      drawn[i] = text[i];
+    }
+  }
+}
+
+void drawChargerRow(int i) {
+  PeripheralScope scope(PERIPH_TFT);
+
   int box_width = 400;   // Full width
   int box_height = 50;   // Increased height for readability
   int x_offset = 30;      // Align left
   int y_offset = 30;     // Start position
   int text_offset = 15;  // Padding for text
 
-  if (last_menu_index == -1) {
-    tft.fillScreen(BG_COLOR);
+  int y_position = y_offset + i * (box_height + 10);
+  bool is_selected = (i == menu_index);
+  bool is_on = relays[i].state;
 
-    for (int i = 0; i < menu_items_size; i++) {
-      int y_position = y_offset + i * (box_height + 10);
-      bool is_selected = (i == menu_index);
-      bool is_on = relays[i].state;
-
-      // Menu box
-      tft.fillRoundRect(x_offset, y_position, box_width, box_height, 5, is_selected ? TFT_BLUE : TFT_LIGHTGREY);
-      // tft.drawRoundRect(x_offset, y_position, box_width, box_height, 5, TFT_WHITE);
-
-      // Menu text
-      tft.setTextSize(2);
-      tft.setCursor(x_offset + text_offset, y_position + 15);
-      tft.setTextColor(is_selected ? TFT_WHITE : TFT_BLACK, is_selected ? TFT_BLUE : TFT_LIGHTGREY);
-      tft.print(menu_items[i]);
-
-      // Toggle Indicator
-      int toggle_x = x_offset + box_width - 140;
-      int toggle_width = 120;
-      int toggle_height = 30;
-
-      // Draw toggle box
-      tft.fillRoundRect(toggle_x, y_position + 10, toggle_width, toggle_height, 5, TFT_BLACK);
-      tft.drawRoundRect(toggle_x, y_position + 10, toggle_width, toggle_height, 5, TFT_WHITE);
-
-      // OFF part
-      tft.fillRect(toggle_x, y_position + 10, toggle_width / 2, toggle_height, is_on ? TFT_DARKGREY : TFT_RED);
-      tft.setTextColor(TFT_WHITE, is_on ? TFT_DARKGREY : TFT_RED);
-      tft.setCursor(toggle_x + 10, y_position + 18);
-      tft.print("OFF");
-
-      // ON part
-      tft.fillRect(toggle_x + (toggle_width / 2), y_position + 10, toggle_width / 2, toggle_height, is_on ? TFT_GREEN : TFT_DARKGREY);
-      tft.setTextColor(TFT_WHITE, is_on ? TFT_GREEN : TFT_DARKGREY);
-      tft.setCursor(toggle_x + 10 + (toggle_width / 2), y_position + 18);
-      tft.print("ON");
-    }
-  }
-
-  // Highlight selected menu smoothly
-  if (last_menu_index != menu_index) {
-    int prev_y = y_offset + last_menu_index * (box_height + 10);
-    int new_y = y_offset + menu_index * (box_height + 10);
-
-    if (last_menu_index >= 0) {
-      // Reset previous selection
-      tft.fillRoundRect(x_offset, prev_y, box_width, box_height, 5, TFT_LIGHTGREY);
-      tft.setTextColor(TXT_COLOR_1, TFT_LIGHTGREY);
-      tft.setCursor(x_offset + text_offset, prev_y + 15);
-      tft.print(menu_items[last_menu_index]);
-
-      // Redraw toggle
-      int toggle_x = x_offset + box_width - 140;
-      bool prev_state = relays[last_menu_index].state;
-      tft.fillRect(toggle_x, prev_y + 10, 60, 30, prev_state ? TFT_DARKGREY : TFT_RED);
-      tft.fillRect(toggle_x + 60, prev_y + 10, 60, 30, prev_state ? TFT_GREEN : TFT_DARKGREY);
-      tft.setTextColor(TFT_WHITE, prev_state ? TFT_GREEN : TFT_DARKGREY);
-      tft.setCursor(toggle_x + 70, prev_y + 18);
-      tft.print("ON");
-      tft.setTextColor(TFT_WHITE, prev_state ? TFT_DARKGREY : TFT_RED);
-      tft.setCursor(toggle_x + 10, prev_y + 18);
-      tft.print("OFF");
-    }
-
-    // Highlight new selection
-    tft.fillRoundRect(x_offset, new_y, box_width, box_height, 5, TFT_BLUE);
-    tft.setTextColor(TFT_WHITE, TFT_BLUE);
-    tft.setCursor(x_offset + text_offset, new_y + 15);
-    tft.print(menu_items[menu_index]);
-
-    // Redraw toggle
-    int toggle_x = x_offset + box_width - 140;
-    bool new_state = relays[menu_index].state;
-    tft.fillRect(toggle_x, new_y + 10, 60, 30, new_state ? TFT_DARKGREY : TFT_RED);
-    tft.fillRect(toggle_x + 60, new_y + 10, 60, 30, new_state ? TFT_GREEN : TFT_DARKGREY);
-    tft.setTextColor(TFT_WHITE, new_state ? TFT_GREEN : TFT_DARKGREY);
-    tft.setCursor(toggle_x + 70, new_y + 18);
-    tft.print("ON");
-    tft.setTextColor(TFT_WHITE, new_state ? TFT_DARKGREY : TFT_RED);
-    tft.setCursor(toggle_x + 10, new_y + 18);
-    tft.print("OFF");
-
-    last_menu_index = menu_index;
-  }
+  // Menu box
+  tft.fillRoundRect(x_offset, y_position, box_width, box_height, 5, is_selected ? TFT_BLUE : TFT_LIGHTGREY);
+
+  // Menu text
+  tft.setTextSize(2);
+  tft.setCursor(x_offset + text_offset, y_position + 15);
+  tft.setTextColor(is_selected ? TFT_WHITE : TFT_BLACK, is_selected ? TFT_BLUE : TFT_LIGHTGREY);
+  tft.print(SLOTS[i].name);
+
+  // Toggle Indicator
+  int toggle_x = x_offset + box_width - 140;
+  int toggle_width = 120;
+  int toggle_height = 30;
+
+  // Remaining time; the box fill above wiped the old glyphs
+  memset(menu_countdown[i], 0, sizeof(menu_countdown[i]));
+  drawRowCountdown(i);
+
+  // Draw toggle box
+  tft.fillRoundRect(toggle_x, y_position + 10, toggle_width, toggle_height, 5, TFT_BLACK);
+  tft.drawRoundRect(toggle_x, y_position + 10, toggle_width, toggle_height, 5, TFT_WHITE);
+
+  // OFF part
+  tft.fillRect(toggle_x, y_position + 10, toggle_width / 2, toggle_height, is_on ? TFT_DARKGREY : TFT_RED);
+  tft.setTextColor(TFT_WHITE, is_on ? TFT_DARKGREY : TFT_RED);
+  tft.setCursor(toggle_x + 10, y_position + 18);
+  tft.print("OFF");
+
+  // ON part
+  tft.fillRect(toggle_x + (toggle_width / 2), y_position + 10, toggle_width / 2, toggle_height, is_on ? TFT_GREEN : TFT_DARKGREY);
+  tft.setTextColor(TFT_WHITE, is_on ? TFT_GREEN : TFT_DARKGREY);
+  tft.setCursor(toggle_x + 10 + (toggle_width / 2), y_position + 18);
+  tft.print("ON");
 }
 
 
@@ -909,155 +2159,1665 @@ void displayChargerList() {
 // }
 
 void displayChargerEnableConf() {
-  tft.fillScreen(BG_COLOR);
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_CONFIRM_ENABLE, "enable_conf", STR_CONFIRM_ENABLE, SLOTS[menu_index].name)) return;
 
-  int x_offset = 30;
-  int y_offset = 30;
-  
-  // Title
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.print("Apakah Anda Yakin untuk");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.printf("Mengaktifkan [%s]", menu_items[menu_index]);
-  tft.setCursor(x_offset, y_offset + 60);
-  tft.print("==================================");
-
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 110);
-  tft.print("Tekan L untuk Lanjut");
-  tft.setCursor(x_offset, y_offset + 140);
-  tft.print("Tekan R untuk Kembali");
+  ScreenTimer timer("enable_conf");
+
+  drawScreen(SCREEN_CONFIRM_ENABLE, SLOTS[menu_index].name);
 }
 
 void displayChargerEnableSuccess() {
-  tft.fillScreen(BG_COLOR);
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_ENABLE_SUCCESS, "enable_success")) return;
 
-  int x_offset = 30;
-  int y_offset = 30;
-  
-  // Message
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.printf("Charger Berhasil Diaktifkan!");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.print("==================================");
+  ScreenTimer timer("enable_success");
 
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 90);
-  tft.print("Tekan tombol apapun untuk Keluar");
+  drawScreen(SCREEN_ENABLE_SUCCESS);
 }
 
 void displayDoorLockWaitMenu() {
-  tft.fillScreen(BG_COLOR);
+  PeripheralScope scope(PERIPH_TFT);
+  int screen = isDoorSlotOn() ? SCREEN_DOOR_INSERT : SCREEN_DOOR_REMOVE;
+  if (requestImage(screen, "door_lock")) return;
 
-  int x_offset = 30;
-  int y_offset = 30;
-  
-  // Message
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.print("Charger Berhasil ");
-  tft.print((relays[4].state)? "Diaktifkan!" : "Dinonaktifkan!");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.print("==================================");
+  ScreenTimer timer("door_lock");
 
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 90);
-  tft.print("Silahkan ");
-  tft.print((relays[4].state)? "masukkan" : "keluarkan");
-  tft.print(" baterai Anda");
+  drawScreen(screen);
 }
 
 void displayChargerDisableConf() {
-  tft.fillScreen(BG_COLOR);
-  
-  int x_offset = 30;
-  int y_offset = 30;
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_CONFIRM_DISABLE, "disable_conf", STR_CONFIRM_DISABLE, SLOTS[current_uid_index].name)) return;
 
-  // Title
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.print("Apakah Anda Yakin untuk");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.printf("menonaktifkan %s", menu_items[current_uid_index]);
-  tft.setCursor(x_offset, y_offset + 60);
-  tft.print("==================================");
-
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 110);
-  tft.print("Tekan L untuk Lanjut");
-  tft.setCursor(x_offset, y_offset + 140);
-  tft.print("Tekan R untuk Kembali");
+  ScreenTimer timer("disable_conf");
+
+  drawScreen(SCREEN_CONFIRM_DISABLE, SLOTS[current_uid_index].name);
 }
 
 void displayChargerDisableSuccess() {
-  tft.fillScreen(BG_COLOR);
-  
-  int x_offset = 30;
-  int y_offset = 30;
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_DISABLE_SUCCESS, "disable_success")) return;
 
-  // Message
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.printf("Charger Berhasil Dinonaktifkan!");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.print("==================================");
+  ScreenTimer timer("disable_success");
 
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 90);
-  tft.print("Tekan tombol apapun untuk Keluar");
+  drawScreen(SCREEN_DISABLE_SUCCESS);
 }
 
 void displayLogoutMenu() {
-  tft.fillScreen(BG_COLOR);
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_LOGOUT, "logout")) return;
 
-  // Title
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.drawString("Terima Kasih", tft.width() / 2, tft.height() / 2);
+  ScreenTimer timer("logout");
 
-  // // Instructions
-  // tft.setTextSize(2);
-  // tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  // tft.drawString("Please wait...", tft.width() / 2, tft.height() / 2);
+  drawScreen(SCREEN_LOGOUT);
+}
+
+void displayCardDenied() {
+  PeripheralScope scope(PERIPH_TFT);
+
+  int screen;
+  switch (current_policy_result) {
+  case POLICY_BLOCKED:
+    screen = SCREEN_DENIED_BLOCKED;
+    break;
+  case POLICY_EXPIRED:
+    screen = SCREEN_DENIED_EXPIRED;
+    break;
+  default:
+    screen = SCREEN_DENIED_QUOTA;
+    break;
+  }
+
+  if (requestImage(screen, "card_denied")) return;
+
+  ScreenTimer timer("card_denied");
+
+  drawScreen(screen);
 }
 
 void displayChargerFull() {
-  tft.fillScreen(BG_COLOR);
-  
-  int x_offset = 30;
-  int y_offset = 30;
+  PeripheralScope scope(PERIPH_TFT);
+  if (requestImage(SCREEN_CHARGER_FULL, "charger_full")) return;
 
-  // Message
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset);
-  tft.printf("Maaf, semua charger sedang digunakan.");
-  tft.setCursor(x_offset, y_offset + 30);
-  tft.print("==================================");
+  ScreenTimer timer("charger_full");
 
-  // Instructions
-  tft.setTextSize(2);
-  tft.setTextColor(TXT_COLOR_1, BG_COLOR);
-  tft.setCursor(x_offset, y_offset + 90);
-  tft.print("Tekan tombol apapun untuk Keluar");
-}
\ No newline at end of file
+  drawScreen(SCREEN_CHARGER_FULL);
+}
+
+// Heap telemetry
+// Counting wrappers around the allocator. Linked in through -Wl,--wrap so every
+// malloc in the image, including the ones made by String, goes through here.
+extern "C" {
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t n, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+
+  void *__wrap_malloc(size_t size) {
+    if (xTaskGetCurrentTaskHandle() == loop_task) heap_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+  }
+
+  void *__wrap_calloc(size_t n, size_t size) {
+    if (xTaskGetCurrentTaskHandle() == loop_task) heap_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(n, size);
+  }
+
+  void *__wrap_realloc(void *ptr, size_t size) {
+    if (xTaskGetCurrentTaskHandle() == loop_task) heap_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+  }
+}
+
+void updateHeapStats(bool is_steady_state) {
+  uint32_t now_allocs = heap_alloc_count.load(std::memory_order_relaxed);
+
+  heap_stats.last_loop_allocs = now_allocs - heap_stats.loop_start_allocs;
+  heap_stats.loop_start_allocs = now_allocs;
+
+  if (heap_stats.last_loop_allocs > heap_stats.max_loop_allocs) {
+    heap_stats.max_loop_allocs = heap_stats.last_loop_allocs;
+  }
+
+  if (is_steady_state && heap_stats.last_loop_allocs > 0) {
+    heap_stats.steady_alloc_loops++;
+  }
+
+  if (serial_quiet) return;
+
+  if (report_out.length == 0 && millis() - heap_stats.report_timer >= HEAP_REPORT_INTERVAL) {
+    heap_stats.report_timer = millis();
+    reportHeapStats();
+    reportCardLookupStats();
+    reportRenderStats();
+    reportTapStats();
+    reportIdleStats();
+    reportTelemetryStats();
+  }
+
+  // Only as much as the UART can take without waiting, the rest on later passes
+  if (report_out.length > 0) {
+    int room = Serial.availableForWrite();
+    int left = report_out.length - report_out.sent;
+    int chunk = left < room ? left : room;
+    if (chunk > 0) {
+      Serial.write((const uint8_t *)report_out.text + report_out.sent, chunk);
+      report_out.sent += chunk;
+    }
+    if (report_out.sent >= report_out.length) report_out.length = report_out.sent = 0;
+  }
+}
+
+// Appends a line to the pending reports, cut short when the buffer is full
+void reportf(const char *format, ...) {
+  int room = (int)sizeof(report_out.text) - report_out.length;
+  if (room <= 1) return;
+
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(report_out.text + report_out.length, room, format, args);
+  va_end(args);
+  if (written > 0) report_out.length += written < room ? written : room - 1;
+}
+
+void reportHeapStats() {
+  size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  int frag = (free_heap > 0) ? 100 - (int)(largest_block * 100 / free_heap) : 0;
+
+  if (heap_stats.baseline_frag < 0) {
+    heap_stats.baseline_frag = frag;
+  }
+
+  reportf("[heap] free=%u largest=%u min_free=%u frag=%d%% allocs_last_loop=%u max_loop_allocs=%u steady_alloc_loops=%u stack_high_water=%u\n",
+    (unsigned)free_heap, (unsigned)largest_block, (unsigned)ESP.getMinFreeHeap(), frag,
+    (unsigned)heap_stats.last_loop_allocs, (unsigned)heap_stats.max_loop_allocs, (unsigned)heap_stats.steady_alloc_loops,
+    (unsigned)stall_record.stack_high_water);
+
+  if (heap_stats.steady_alloc_loops > 0) {
+    reportf("[heap] WARNING: allocations on the steady-state path\n");
+  }
+
+  if (frag - heap_stats.baseline_frag > HEAP_FRAG_WARN_DELTA) {
+    reportf("[heap] WARNING: fragmentation grew from %d%% to %d%%\n", heap_stats.baseline_frag, frag);
+  }
+}
+
+// Loop stall watchdog
+void reportLastStall() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool was_stall = (reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_WDT);
+
+  if (was_stall && stall_record.magic == STALL_RECORD_MAGIC) {
+    uint8_t page = stall_record.page < sizeof(page_names) / sizeof(page_names[0]) ? stall_record.page : 0;
+    uint8_t peripheral = stall_record.peripheral < sizeof(peripheral_names) / sizeof(peripheral_names[0]) ? stall_record.peripheral : 0;
+
+    Serial.printf("[wdt] Recovered from loop stall: page=%s peripheral=%s since=%lu ms stack_high_water=%u bytes\n",
+      page_names[page], peripheral_names[peripheral], (unsigned long)stall_record.uptime, (unsigned)stall_record.stack_high_water);
+  } else if (was_stall) {
+    Serial.println("[wdt] Recovered from loop stall, no stall record");
+  }
+
+  // Start a fresh record for this run
+  stall_record.magic = STALL_RECORD_MAGIC;
+  stall_record.page = SCAN_WAIT;
+  stall_record.peripheral = PERIPH_NONE;
+  stall_record.uptime = 0;
+  stall_record.stack_high_water = UINT32_MAX;
+}
+
+void updateStallRecord() {
+  stall_record.page = current_page;
+  stall_record.peripheral = PERIPH_NONE;
+
+  // On the ESP32 the high water mark is reported in bytes
+  uint32_t high_water = uxTaskGetStackHighWaterMark(NULL);
+  if (high_water < stall_record.stack_high_water) {
+    stall_record.stack_high_water = high_water;
+  }
+}
+
+// Card index
+// The index is a sorted array of CardRecord, generated off-device from
+// card_list.csv. A Bloom filter rejects unknown cards without touching the
+// SD card, candidates are confirmed by a binary search that reads at most
+// log2(fence_stride) + 1 blocks through a small LRU cache.
+uint32_t cardHash(const char *uid) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const char *c = uid; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void bloomPositions(const char *uid, uint32_t *positions) {
+  uint32_t h1 = cardHash(uid);
+  uint32_t h2 = ((h1 >> 16) | (h1 << 16)) * 0x9E3779B1u | 1;
+
+  for (int i = 0; i < card_index.bloom_hashes; i++) {
+    positions[i] = (h1 + i * h2) % card_index.bloom_bits;
+  }
+}
+
+void bloomAdd(const char *uid) {
+  uint32_t positions[CARD_BLOOM_HASHES];
+  bloomPositions(uid, positions);
+
+  for (int i = 0; i < card_index.bloom_hashes; i++) {
+    card_index.bloom[positions[i] >> 3] |= 1 << (positions[i] & 7);
+  }
+}
+
+bool bloomMayContain(const char *uid) {
+  if (card_index.bloom == NULL) return true; // No filter, everything goes to SD
+
+  uint32_t positions[CARD_BLOOM_HASHES];
+  bloomPositions(uid, positions);
+
+  for (int i = 0; i < card_index.bloom_hashes; i++) {
+    if (!(card_index.bloom[positions[i] >> 3] & (1 << (positions[i] & 7)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t cardRecordsInBlock(uint32_t block) {
+  uint32_t first = block * CARD_RECORDS_PER_BLOCK;
+  uint32_t left = card_index.record_count - first;
+  return left < CARD_RECORDS_PER_BLOCK ? left : CARD_RECORDS_PER_BLOCK;
+}
+
+// Returns the cached block, reading it from SD on a miss
+const CardRecord *readCardBlock(uint32_t block) {
+  CardCacheBlock *victim = &card_index.cache[0];
+  card_index.cache_clock++;
+
+  for (int i = 0; i < CARD_CACHE_BLOCKS; i++) {
+    CardCacheBlock *entry = &card_index.cache[i];
+    if (entry->block == (int32_t)block) {
+      entry->last_used = card_index.cache_clock;
+      return entry->records;
+    }
+    if (entry->block < 0 || entry->last_used < victim->last_used) {
+      victim = entry;
+    }
+  }
+
+  PeripheralScope scope(PERIPH_SD);
+  size_t len = cardRecordsInBlock(block) * CARD_RECORD_SIZE;
+  if (!card_index.file.seek(block * CARD_BLOCK_SIZE) ||
+      card_index.file.read((uint8_t *)victim->records, len) != len) {
+    victim->block = -1;
+    return NULL;
+  }
+
+  card_index.sd_reads++;
+  victim->block = block;
+  victim->last_used = card_index.cache_clock;
+  return victim->records;
+}
+
+bool loadCardIndex() {
+  PeripheralScope scope(PERIPH_SD);
+  card_index.file = SD.open(CARD_INDEX_PATH);
+  if (!card_index.file) {
+    return false;
+  }
+
+  card_index.record_count = card_index.file.size() / CARD_RECORD_SIZE;
+  card_index.block_count = (card_index.record_count + CARD_RECORDS_PER_BLOCK - 1) / CARD_RECORDS_PER_BLOCK;
+  if (card_index.record_count == 0) {
+    card_index.file.close();
+    return false;
+  }
+
+  Serial.printf("Loading card index, %u cards...\n", (unsigned)card_index.record_count);
+
+  card_index.fence_stride = (card_index.block_count + CARD_FENCE_MAX - 1) / CARD_FENCE_MAX;
+  card_index.fence_count = 0;
+
+  // A filter cut down to the cap or the free RAM lets more unknown cards
+  // through to SD, but still keeps most of them away
+  uint32_t bloom_bytes = (card_index.record_count * CARD_BLOOM_BITS_PER_CARD + 7) / 8;
+  if (bloom_bytes > CARD_BLOOM_MAX_BYTES) bloom_bytes = CARD_BLOOM_MAX_BYTES;
+  size_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  size_t room = largest_block > CARD_BLOOM_HEAP_MARGIN ? largest_block - CARD_BLOOM_HEAP_MARGIN : 0;
+  if (bloom_bytes > room) bloom_bytes = room;
+
+  card_index.bloom = bloom_bytes > 0 ? (uint8_t *)calloc(bloom_bytes, 1) : NULL;
+  card_index.bloom_bits = card_index.bloom != NULL ? bloom_bytes * 8 : 0;
+
+  // Fewest false positives at bits per card * ln 2 hashes
+  card_index.bloom_hashes = (int)((card_index.bloom_bits * 69ULL / 100 + card_index.record_count / 2) / card_index.record_count);
+  if (card_index.bloom_hashes < 1) card_index.bloom_hashes = 1;
+  if (card_index.bloom_hashes > CARD_BLOOM_HASHES) card_index.bloom_hashes = CARD_BLOOM_HASHES;
+  if (card_index.bloom == NULL) {
+    Serial.println("Not enough RAM for the card filter, every lookup will read SD");
+  }
+
+  for (int i = 0; i < CARD_CACHE_BLOCKS; i++) {
+    card_index.cache[i].block = -1;
+    card_index.cache[i].last_used = 0;
+  }
+
+  // One sequential pass fills the filter and the fence keys
+  CardRecord *records = card_index.cache[0].records;
+  card_index.file.seek(0);
+
+  for (uint32_t block = 0; block < card_index.block_count; block++) {
+    uint32_t count = cardRecordsInBlock(block);
+    if (card_index.file.read((uint8_t *)records, count * CARD_RECORD_SIZE) != count * CARD_RECORD_SIZE) {
+      Serial.println("Card index is truncated");
+      card_index.file.close();
+      free(card_index.bloom);
+      card_index.bloom = NULL;
+      return false;
+    }
+
+    if (block % card_index.fence_stride == 0) {
+      memcpy(card_index.fence[card_index.fence_count++], records[0].uid, MAX_UID_LEN);
+    }
+
+    if (card_index.bloom != NULL) {
+      for (uint32_t i = 0; i < count; i++) {
+        records[i].uid[MAX_UID_LEN - 1] = '\0';
+        bloomAdd(records[i].uid);
+      }
+    }
+
+    if (block % 64 == 63) {
+      storageYield();
+    }
+  }
+
+  card_index.available = true;
+
+  Serial.printf("Card index loaded: filter=%u bytes cache=%u bytes fence=%u bytes\n",
+    (unsigned)((card_index.bloom_bits + 7) / 8), (unsigned)sizeof(card_index.cache), (unsigned)sizeof(card_index.fence));
+  return true;
+}
+
+bool findCardRecord(const char *uid, CardRecord *out) {
+  unsigned long start = micros();
+  uint32_t reads_before = card_index.sd_reads;
+  bool found = false;
+
+  card_index.lookups++;
+
+  if (!bloomMayContain(uid)) {
+    card_index.bloom_rejects++;
+  } else {
+    // Fence keys pick the group of blocks the UID can be in
+    uint32_t lo = 0;
+    uint32_t hi = card_index.fence_count;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if (strncmp(card_index.fence[mid], uid, MAX_UID_LEN) <= 0) lo = mid + 1;
+      else hi = mid;
+    }
+
+    if (lo > 0) {
+      uint32_t first_block = (lo - 1) * card_index.fence_stride;
+      uint32_t last_block = first_block + card_index.fence_stride;
+      if (last_block > card_index.block_count) last_block = card_index.block_count;
+
+      // Binary search over the records of those blocks
+      uint32_t left = first_block * CARD_RECORDS_PER_BLOCK;
+      uint32_t right = last_block * CARD_RECORDS_PER_BLOCK;
+      if (right > card_index.record_count) right = card_index.record_count;
+
+      while (left < right) {
+        uint32_t mid = (left + right) / 2;
+        const CardRecord *block = readCardBlock(mid / CARD_RECORDS_PER_BLOCK);
+        if (block == NULL) break;
+
+        const CardRecord *record = &block[mid % CARD_RECORDS_PER_BLOCK];
+        int cmp = strncmp(record->uid, uid, MAX_UID_LEN);
+        if (cmp == 0) {
+          if (out != NULL) *out = *record;
+          found = true;
+          break;
+        }
+        if (cmp < 0) left = mid + 1;
+        else right = mid;
+      }
+    }
+  }
+
+  uint32_t reads = card_index.sd_reads - reads_before;
+  if (reads > card_index.max_sd_reads) card_index.max_sd_reads = reads;
+
+  unsigned long elapsed = micros() - start;
+  int bucket = 0;
+  while (bucket < 15 && (1UL << (bucket + 1)) <= elapsed) bucket++;
+  card_index.lookup_us_hist[bucket]++;
+
+  return found;
+}
+
+void reportCardLookupStats() {
+  if (!card_index.available || card_index.lookups == 0) return;
+
+  // p99 as the upper edge of the histogram bucket holding it
+  uint32_t target = card_index.lookups - card_index.lookups / 100;
+  uint32_t seen = 0;
+  int bucket = 0;
+  for (; bucket < 16; bucket++) {
+    seen += card_index.lookup_us_hist[bucket];
+    if (seen >= target) break;
+  }
+
+  reportf("[cards] lookups=%u filter_rejects=%u sd_reads=%u max_sd_reads=%u p99<%lu us\n",
+    (unsigned)card_index.lookups, (unsigned)card_index.bloom_rejects, (unsigned)card_index.sd_reads,
+    (unsigned)card_index.max_sd_reads, 1UL << (bucket + 1));
+}
+
+// Card policy
+// Days since 1970-01-01 for a civil date (H. Hinnant's days_from_civil)
+long daysFromCivil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (long)doe - 719468;
+}
+
+// Splits off the next comma separated field, empty fields are kept
+char *nextField(char **cursor) {
+  char *field = *cursor;
+  if (field == NULL) return NULL;
+
+  char *comma = strchr(field, ',');
+  if (comma != NULL) {
+    *comma = '\0';
+    *cursor = comma + 1;
+  } else {
+    *cursor = NULL;
+  }
+  return field;
+}
+
+// Columns: slots ("*" or slot numbers like "13"), daily quota in minutes,
+// expiry as YYYY-MM-DD, blocked (0/1). Empty columns keep the default.
+bool parseCardPolicy(char *fields, CardPolicy *policy) {
+  char *cursor = fields;
+  char *slots = nextField(&cursor);
+  char *quota = nextField(&cursor);
+  char *expiry = nextField(&cursor);
+  char *blocked = nextField(&cursor);
+
+  if (slots != NULL && slots[0] != '\0' && slots[0] != '*') {
+    policy->slot_mask = 0;
+    for (char *c = slots; *c; c++) {
+      if (*c < '1' || *c > '8') return false;
+      policy->slot_mask |= 1 << (*c - '1');
+    }
+  }
+
+  if (quota != NULL && quota[0] != '\0') {
+    policy->daily_quota = (uint16_t)atoi(quota);
+  }
+
+  if (expiry != NULL && expiry[0] != '\0') {
+    int y, m, d;
+    if (sscanf(expiry, "%d-%d-%d", &y, &m, &d) != 3) return false;
+    policy->expiry_day = (uint32_t)daysFromCivil(y, m, d);
+  }
+
+  if (blocked != NULL && blocked[0] == '1') {
+    policy->flags |= CARD_BLOCKED;
+  }
+
+  return true;
+}
+
+// Wall clock is only trusted once it has been set, by NTP in TELEMETRY builds
+// (see telemetryStep) or the "time <epoch>" serial command. Until then expiry
+// is not enforced, quota days count from boot (and start over after a reset)
+// and sessions are recorded without an end time (no hourly split, no last use).
+bool isClockValid() {
+  return time(NULL) > CLOCK_VALID_AFTER;
+}
+
+// Local day number; falls back to days of uptime while the clock is unset
+uint16_t currentDay() {
+  if (isClockValid()) {
+    return (uint16_t)((time(NULL) + TIME_UTC_OFFSET) / 86400);
+  }
+  return (uint16_t)(millis() / 86400000UL);
+}
+
+UsageEntry *findUsageEntry(const char *uid, bool create) {
+  uint32_t start = cardHash(uid) % USAGE_TABLE_SIZE;
+  uint16_t today = isClockValid() ? currentDay() : currentDay() | USAGE_UPTIME_DAY;
+  UsageEntry *stale = NULL;
+
+  for (int i = 0; i < USAGE_MAX_PROBE; i++) {
+    UsageEntry *entry = &usage_table.entries[(start + i) % USAGE_TABLE_SIZE];
+    if (strncmp(entry->uid, uid, MAX_UID_LEN) == 0) {
+      // Lazy rollover at the day boundary
+      if (entry->day != today) {
+        entry->day = today;
+        entry->minutes = 0;
+      }
+      return entry;
+    }
+    if (stale == NULL && (entry->uid[0] == '\0' || entry->day != today)) {
+      stale = entry;
+    }
+  }
+
+  // Reuse an empty or old slot. A probe window full of today's cards has no
+  // room: overwriting one would reset that card's minutes.
+  if (!create || stale == NULL) return NULL;
+  strncpy(stale->uid, uid, MAX_UID_LEN - 1);
+  stale->uid[MAX_UID_LEN - 1] = '\0';
+  stale->day = today;
+  stale->minutes = 0;
+  return stale;
+}
+
+PolicyResult checkCardPolicy(const char *uid, const CardPolicy &policy) {
+  if (policy.flags & CARD_BLOCKED) {
+    return POLICY_BLOCKED;
+  }
+
+  // Expiry needs a real date, it is not enforced while the clock is unset
+  if (policy.expiry_day != 0 && isClockValid() && currentDay() > policy.expiry_day) {
+    return POLICY_EXPIRED;
+  }
+
+  // Quota cards get their usage entry before the session starts, so the
+  // minutes always have somewhere to go. No room means no session.
+  if (policy.daily_quota != 0) {
+    UsageEntry *entry = findUsageEntry(uid, true);
+    if (entry == NULL) {
+      Serial.print("Usage table full, denying quota card: "); Serial.println(uid);
+      return POLICY_QUOTA_USED;
+    }
+    if (entry->minutes >= policy.daily_quota) {
+      return POLICY_QUOTA_USED;
+    }
+  }
+
+  return POLICY_OK;
+}
+
+bool isSlotAllowed(int slot) {
+  return current_policy.slot_mask & (1 << slot);
+}
+
+// Only cards with a quota have an entry (see checkCardPolicy), others are not tracked
+void addCardUsage(const char *uid, unsigned long elapsed_ms) {
+  if (uid[0] == '\0') return;
+
+  UsageEntry *entry = findUsageEntry(uid, false);
+  if (entry == NULL) return;
+  unsigned long minutes = (elapsed_ms + 59999) / 60000; // Started minutes count
+  entry->minutes = (entry->minutes + minutes > 0xFFFF) ? 0xFFFF : entry->minutes + minutes;
+  usage_dirty = true;
+}
+
+void loadUsageTable() {
+  PeripheralScope scope(PERIPH_SD);
+  memset(&usage_table, 0, sizeof(usage_table));
+
+  File file = SD.open(USAGE_PATH);
+  if (file) {
+    if (file.read((uint8_t *)&usage_table, sizeof(usage_table)) != sizeof(usage_table) || usage_table.magic != USAGE_MAGIC) {
+      Serial.println("Ignoring invalid card_usage.bin");
+      memset(&usage_table, 0, sizeof(usage_table));
+    }
+    file.close();
+  }
+
+  // Days since the previous boot say nothing about today
+  for (int i = 0; i < USAGE_TABLE_SIZE; i++) {
+    if (usage_table.entries[i].day & USAGE_UPTIME_DAY) {
+      memset(&usage_table.entries[i], 0, sizeof(usage_table.entries[i]));
+    }
+  }
+
+  usage_table.magic = USAGE_MAGIC;
+  usage_checkpoint_timer = millis();
+}
+
+void checkpointUsageTable() {
+  PeripheralScope scope(PERIPH_SD);
+  usage_checkpoint_timer = millis();
+
+  File file = SD.open(USAGE_PATH, FILE_WRITE);
+  if (!file) {
+    Serial.println("Failed to write card_usage.bin");
+    return;
+  }
+
+  file.write((const uint8_t *)&usage_table, sizeof(usage_table));
+  file.close();
+  usage_dirty = false;
+}
+
+// Boot sequence
+// SD mount, card list and usage table, run as a task on core 0 during boot
+void storageInitTask(void *param) {
+  bootStepStart(BOOT_SD);
+  bool mounted;
+  {
+    PeripheralScope scope(PERIPH_SD);
+    mounted = SD.begin(SD_CS, vspi);
+  }
+  bootStepEnd(BOOT_SD, mounted);
+  storage_task_mounted = mounted;
+
+  if (!mounted) {
+    Serial.println("Card Mount Failed");
+    storage_task_error = STR_SD_MOUNT_FAILED;
+  } else {
+    Serial.println("SD Card initialized successfully.");
+
+    // Large fleets use the sorted index, small sites the CSV list
+    bootStepStart(BOOT_CARDS);
+    if (!loadCardIndex()) {
+      loadCardList();
+    }
+    loadUsageTable();
+    loadAnalytics();
+    bootStepEnd(BOOT_CARDS, card_index.available || cardCount > 0);
+  }
+
+  xSemaphoreGive(storage_ready);
+
+  // param is only set when started as a task, the fallback runs inline
+  if (param != NULL) {
+    vTaskDelete(NULL);
+  }
+}
+
+// Long storage loads give way now and then: to the core 0 idle task as a
+// task, to the loop watchdog when setup() had to run them inline
+void storageYield() {
+  if (storage_inline) {
+    esp_task_wdt_reset();
+  } else {
+    delay(1);
+  }
+}
+
+// Takes over the storage task's results on core 1, in setup() or, when the
+// task outlived BOOT_STORAGE_TIMEOUT, later from loop()
+bool takeStorageResult(TickType_t wait) {
+  if (storage_loaded) return true;
+  if (xSemaphoreTake(storage_ready, wait) != pdTRUE) return false;
+
+  storage_loaded = true;
+  sd_mounted = storage_task_mounted;
+  storage_error = storage_task_error;
+  return true;
+}
+
+void bootStepStart(BootStep step) {
+  boot_timings[step].start = micros();
+  boot_timings[step].core = xPortGetCoreID();
+}
+
+void bootStepEnd(BootStep step, bool ok) {
+  boot_timings[step].end = micros();
+  boot_timings[step].ok = ok;
+}
+
+void reportBootTimings() {
+  for (int i = 0; i < BOOT_STEP_COUNT; i++) {
+    BootTiming &timing = boot_timings[i];
+    if (timing.start == 0) {
+      Serial.printf("[boot] %-10s skipped\n", boot_step_names[i]);
+      continue;
+    }
+    Serial.printf("[boot] %-10s core=%d start=%lu ms took=%lu ms %s\n", boot_step_names[i], timing.core,
+      timing.start / 1000, (timing.end - timing.start) / 1000, timing.ok ? "ok" : "FAILED");
+  }
+
+  // setup() returning is the point where the first scan can be served
+  Serial.printf("[boot] time_to_first_scan=%lu ms\n", millis());
+}
+
+// Idle mode
+// Backlight PWM runs from the RTC8M clock so it keeps its level through light sleep
+void initBacklight() {
+#ifdef TFT_BL
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = LEDC_LOW_SPEED_MODE;
+  timer.duty_resolution = LEDC_TIMER_8_BIT;
+  timer.timer_num = LEDC_TIMER_1;
+  timer.freq_hz = 5000;
+  timer.clk_cfg = LEDC_USE_RTC8M_CLK;
+  ledc_timer_config(&timer);
+
+  ledc_channel_config_t channel = {};
+  channel.gpio_num = TFT_BL;
+  channel.speed_mode = LEDC_LOW_SPEED_MODE;
+  channel.channel = LEDC_CHANNEL_1;
+  channel.timer_sel = LEDC_TIMER_1;
+  ledc_channel_config(&channel);
+
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);
+#endif
+  setBacklight(BACKLIGHT_FULL);
+}
+
+void setBacklight(uint8_t level) {
+#ifdef TFT_BL
+#if defined(TFT_BACKLIGHT_ON) && TFT_BACKLIGHT_ON == LOW
+  level = 255 - level;
+#endif
+  ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1, level);
+  ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1);
+#else
+  (void)level;
+#endif
+}
+
+void markActivity() {
+  idle.activity_timer = millis();
+  if (idle.dimmed) {
+    setBacklight(BACKLIGHT_FULL);
+    idle.dimmed = false;
+  }
+}
+
+// Shortens the sleep so it ends by the deadline
+static void limitSleep(unsigned long &sleep_ms, unsigned long now, unsigned long deadline) {
+  long left = (long)(deadline - now);
+  if (left < (long)sleep_ms) {
+    sleep_ms = left > 0 ? left : 0;
+  }
+}
+
+// Light sleep on the scan screen until the next deadline: a due reader poll, a relay
+// expiry, the countdown tick or the dot animation. Reader polls are at most
+// READER_POLL_MAX apart, which bounds how late a tap or relay expiry is handled.
+// Buttons and the door wake the CPU early. The UART clock stops while asleep:
+// pending TX is flushed first, RX bytes arriving during the sleep are dropped.
+void idleSleep() {
+  unsigned long now = millis();
+
+  if (!idle.dimmed && now - idle.activity_timer >= IDLE_DIM_TIMEOUT) {
+    setBacklight(BACKLIGHT_DIM);
+    idle.dimmed = true;
+  }
+
+// Manual light sleep turns the radio off, the WiFi link would not survive it
+#if USE_IDLE_SLEEP && !TELEMETRY
+  if (render.dirty != 0 || now - idle.activity_timer < IDLE_SLEEP_DELAY) return;
+  // A command being typed, an export or a report being sent needs the UART running
+  if (command.export_kind != EXPORT_NONE || now - command.rx_timer < SERIAL_AWAKE_TIME) return;
+  if (report_out.length > 0) return; // Reports still going out
+
+  unsigned long sleep_ms = READER_POLL_MAX;
+  bool charging = false;
+
+  for (int i = 0; i < READER_COUNT; i++) {
+    limitSleep(sleep_ms, now, readers[i].next_poll);
+  }
+  for (int i = 0; i < relays_count; i++) {
+    if (relays[i].state) {
+      limitSleep(sleep_ms, now, relays[i].timer + RELAY_ON_TIME + 1);
+      charging = true;
+    }
+  }
+  if (charging) {
+    limitSleep(sleep_ms, now, render.countdown_timer + 1000);
+  }
+  if (!idle.dimmed) {
+    limitSleep(sleep_ms, now, render.dots_timer + SCAN_DOTS_INTERVAL);
+  }
+  if (sleep_ms < IDLE_MIN_SLEEP) return;
+
+  // Wake on the level opposite to the one each input rests at now
+  const uint8_t wake_pins[] = {BUTTON_L, BUTTON_C, BUTTON_R, DOOR_SENSOR};
+  for (size_t i = 0; i < sizeof(wake_pins); i++) {
+    gpio_wakeup_enable((gpio_num_t)wake_pins[i],
+      digitalRead(wake_pins[i]) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  uart_set_wakeup_threshold(UART_NUM_0, UART_WAKE_THRESHOLD);
+  esp_sleep_enable_uart_wakeup(0);
+  esp_sleep_enable_timer_wakeup(sleep_ms * 1000ULL);
+
+  Serial.flush(); // The UART stops during light sleep
+  int64_t start = esp_timer_get_time();
+  esp_light_sleep_start();
+  idle.asleep_us += esp_timer_get_time() - start;
+
+  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+  if (cause == ESP_SLEEP_WAKEUP_GPIO) {
+    idle.gpio_wakes++;
+    markActivity();
+  } else if (cause == ESP_SLEEP_WAKEUP_UART) {
+    // The rest of the command follows, a cut one gets the command list back
+    idle.uart_wakes++;
+    command.rx_timer = millis();
+  } else {
+    idle.timer_wakes++;
+  }
+#endif
+}
+
+void reportIdleStats() {
+  unsigned long window_ms = millis() - idle.report_start;
+  if (window_ms == 0) return;
+
+  unsigned permille = (unsigned)(idle.asleep_us / window_ms); // us / ms = per mille
+  reportf("[idle] asleep=%u.%u%% timer_wakes=%u gpio_wakes=%u uart_wakes=%u dimmed=%d\n",
+    permille / 10, permille % 10, (unsigned)idle.timer_wakes, (unsigned)idle.gpio_wakes,
+    (unsigned)idle.uart_wakes, idle.dimmed);
+
+  idle.asleep_us = 0;
+  idle.timer_wakes = 0;
+  idle.gpio_wakes = 0;
+  idle.uart_wakes = 0;
+  idle.report_start = millis();
+}
+
+// Render cost recording
+// Starts measuring a screen; an unfinished previous one is reported as it is
+void costBegin(const char *screen) {
+#if RENDER_COST
+  costEnd();
+  render_cost.screen = screen;
+  render_cost.pixels = 0;
+  render_cost.spi_bytes = 0;
+  render_cost.calls = 0;
+#else
+  (void)screen;
+#endif
+}
+
+#if RENDER_COST
+// Reference cost of a screen, NULL when it has none
+const RenderBaseline *findBaseline(const char *screen) {
+  for (int i = 0; render_baselines[i].screen != NULL; i++) {
+    if (strcmp(render_baselines[i].screen, screen) == 0) return &render_baselines[i];
+  }
+  return NULL;
+}
+#endif
+
+void costEnd() {
+#if RENDER_COST
+  if (render_cost.screen == NULL) return;
+
+  const RenderBaseline *baseline = findBaseline(render_cost.screen);
+
+  Serial.printf("[cost] %s px=%u spi=%u calls=%u", render_cost.screen,
+    (unsigned)render_cost.pixels, (unsigned)render_cost.spi_bytes, (unsigned)render_cost.calls);
+
+  if (baseline == NULL) {
+    Serial.println(" baseline=none");
+  } else {
+    uint32_t limit = baseline->spi_bytes + baseline->spi_bytes / 100 * COST_REGRESSION_PERCENT;
+    bool regressed = render_cost.spi_bytes > limit;
+    if (regressed) render_cost.regressions++;
+    Serial.printf(" baseline_spi=%u %s\n", (unsigned)baseline->spi_bytes, regressed ? "REGRESSED" : "ok");
+  }
+
+  render_cost.screen = NULL;
+#endif
+}
+
+// Telemetry
+#if TELEMETRY
+WiFiClient telemetry_client;
+PubSubClient mqtt(telemetry_client);
+
+void telemetryTask(void *param);
+#endif
+
+void telemetryBegin() {
+#if TELEMETRY
+  telemetry.queue = xQueueCreate(TELEMETRY_QUEUE_LEN, sizeof(TelemetryLine));
+  telemetry.report_start = millis();
+
+  if (telemetry.queue == NULL ||
+      xTaskCreatePinnedToCore(telemetryTask, "telemetry", 6144, NULL, 1, NULL, 0) != pdPASS) {
+    Serial.println("Telemetry disabled: task start failed");
+    telemetry.queue = NULL;
+  }
+#endif
+}
+
+#if TELEMETRY
+static void telemetryCount(uint32_t &counter, uint32_t n) {
+  portENTER_CRITICAL(&telemetry.mux);
+  counter += n;
+  portEXIT_CRITICAL(&telemetry.mux);
+}
+
+// Queues a line without waiting; the task decides between MQTT and the backlog
+static void telemetryQueue(const TelemetryLine &line) {
+  if (xQueueSend(telemetry.queue, &line, 0) == pdTRUE) {
+    telemetryCount(telemetry.counters.queued, 1);
+  } else {
+    telemetryCount(telemetry.counters.dropped, 1);
+  }
+}
+#endif
+
+// Session and scan events; slot is -1 when none applies
+void telemetryEvent(const char *type, int slot, const char *uid, long value) {
+#if TELEMETRY
+  if (telemetry.queue == NULL) return;
+
+  TelemetryLine line;
+  snprintf(line.text, sizeof(line.text), "%lu,%lu,%s,%d,%s,%ld",
+    isClockValid() ? (unsigned long)time(NULL) : 0UL, millis() / 1000, type, slot, uid, value);
+  line.keep = true;
+  telemetryQueue(line);
+#else
+  (void)type;
+  (void)slot;
+  (void)uid;
+  (void)value;
+#endif
+}
+
+// Periodic snapshot, called every loop pass
+void telemetryStep() {
+#if TELEMETRY
+  if (telemetry.queue == NULL) return;
+  if (millis() - telemetry.snapshot_timer < TELEMETRY_SNAPSHOT_INTERVAL) return;
+  telemetry.snapshot_timer = millis();
+
+  // Snapshot: uid field holds the relay states, value the page
+  char states[SLOT_COUNT + 1];
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    states[i] = relays[i].state ? '1' : '0';
+  }
+  states[SLOT_COUNT] = '\0';
+
+  TelemetryLine line;
+  snprintf(line.text, sizeof(line.text), "%lu,%lu,snap,-1,%s,%d",
+    isClockValid() ? (unsigned long)time(NULL) : 0UL, millis() / 1000, states, (int)current_page);
+  line.keep = false; // A stale snapshot is not worth keeping
+  telemetryQueue(line);
+#endif
+}
+
+#if TELEMETRY
+// The SD backlog, owned by the task: newline-terminated lines from
+// backlog_pos to backlog_size. FatFs is built reentrant in ESP-IDF, so the
+// task's file work may overlap loop()'s.
+struct TelemetryBacklog {
+  uint32_t pos;                   // First unpublished byte
+  uint32_t size;
+};
+
+static void telemetryBacklogChanged(const TelemetryBacklog &backlog) {
+  portENTER_CRITICAL(&telemetry.mux);
+  telemetry.backlog_bytes = backlog.size - backlog.pos;
+  portEXIT_CRITICAL(&telemetry.mux);
+}
+
+// Appends the kept lines of a batch to the backlog in one write
+static void telemetrySpill(TelemetryBacklog &backlog, const TelemetryLine *lines, int count, char *buffer, size_t size) {
+  size_t len = 0;
+  uint32_t kept = 0;
+  for (int i = 0; i < count; i++) {
+    if (!lines[i].keep) continue;
+    len += snprintf(buffer + len, size - len, "%s\n", lines[i].text);
+    if (len >= size) len = size - 1;
+    kept++;
+  }
+  if (count > (int)kept) telemetryCount(telemetry.counters.dropped, count - kept);
+  if (kept == 0) return;
+
+  File file;
+  if (sd_mounted && backlog.size + len <= TELEMETRY_BACKLOG_MAX) {
+    file = SD.open(TELEMETRY_BACKLOG_PATH, FILE_APPEND);
+  }
+  if (!file || file.write((const uint8_t *)buffer, len) != len) {
+    if (file) file.close();
+    telemetryCount(telemetry.counters.dropped, kept);
+    return;
+  }
+  file.close();
+
+  backlog.size += len;
+  telemetryBacklogChanged(backlog);
+  portENTER_CRITICAL(&telemetry.mux);
+  telemetry.counters.spilled += kept;
+  telemetry.counters.spill_writes++;
+  portEXIT_CRITICAL(&telemetry.mux);
+}
+
+// Reads whole backlog lines into buffer as one payload; returns its length
+// and sets lines and taken (bytes to skip once it is published)
+static size_t telemetryReadBacklog(TelemetryBacklog &backlog, char *buffer, size_t size, int *lines, uint32_t *taken) {
+  *lines = 0;
+  *taken = 0;
+  File file = SD.open(TELEMETRY_BACKLOG_PATH);
+  if (!file) {
+    backlog.pos = backlog.size = 0;
+    telemetryBacklogChanged(backlog);
+    return 0;
+  }
+
+  // Shorter than what was appended: what is left is sent, the rest is lost
+  uint32_t file_size = file.size();
+  if (file_size < backlog.size) {
+    telemetryCount(telemetry.counters.lost_bytes, backlog.size - file_size);
+    backlog.size = file_size;
+    if (backlog.pos >= backlog.size) {
+      file.close();
+      SD.remove(TELEMETRY_BACKLOG_PATH);
+      backlog.pos = backlog.size = 0;
+      telemetryBacklogChanged(backlog);
+      return 0;
+    }
+    telemetryBacklogChanged(backlog);
+  }
+
+  file.seek(backlog.pos);
+  uint32_t left = backlog.size - backlog.pos;
+  size_t len = file.read((uint8_t *)buffer, left < size ? left : size);
+  file.close();
+
+  // Up to the last full line; a torn last line (power loss mid-append) is kept as it is
+  size_t end = len;
+  if (len < left) {
+    while (end > 0 && buffer[end - 1] != '\n') end--;
+  }
+  *taken = end;
+  for (size_t i = 0; i < end; i++) {
+    if (buffer[i] == '\n') (*lines)++;
+  }
+  if (end > 0 && buffer[end - 1] != '\n') (*lines)++;
+  return end > 0 && buffer[end - 1] == '\n' ? end - 1 : end;
+}
+
+// WiFi, NTP and MQTT on core 0: batches queued lines into one publish, and
+// into one SD append while offline
+void telemetryTask(void *param) {
+  (void)param;
+  static TelemetryLine batch[TELEMETRY_BATCH_MAX];
+  static char payload[TELEMETRY_BATCH_MAX * TELEMETRY_LINE_LEN];
+  char topic[48];
+  char client_id[24];
+  int batch_count = 0;
+  unsigned long batch_start = 0;
+  bool time_requested = false;
+  unsigned long retry_at = 0;
+  unsigned long retry_delay = MQTT_RETRY_MIN;
+
+  // Lines left from before a reboot are sent again from the start (at least once)
+  TelemetryBacklog backlog = {0, 0};
+  if (sd_mounted) {
+    File file = SD.open(TELEMETRY_BACKLOG_PATH);
+    if (file) {
+      backlog.size = file.size();
+      file.close();
+    }
+  }
+  telemetryBacklogChanged(backlog);
+
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(TELEMETRY_SSID, TELEMETRY_PASSWORD);
+
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(client_id, sizeof(client_id), "evstation-%02x%02x%02x", mac[3], mac[4], mac[5]);
+  snprintf(topic, sizeof(topic), "evstation/%02x%02x%02x/telemetry", mac[3], mac[4], mac[5]);
+
+  mqtt.setServer(TELEMETRY_BROKER, TELEMETRY_PORT);
+  mqtt.setBufferSize(sizeof(payload) + 64);
+  mqtt.setSocketTimeout(2);
+
+  for (;;) {
+    bool online = false;
+    if (WiFi.status() == WL_CONNECTED) {
+      // Sets the clock, which turns on calendar days for quotas
+      if (!time_requested) {
+        configTime(0, 0, "pool.ntp.org");
+        time_requested = true;
+      }
+
+      if (!mqtt.connected() && (long)(millis() - retry_at) >= 0) {
+        if (mqtt.connect(client_id)) {
+          retry_delay = MQTT_RETRY_MIN;
+        } else {
+          retry_at = millis() + retry_delay;
+          retry_delay = retry_delay * 2 < MQTT_RETRY_MAX ? retry_delay * 2 : MQTT_RETRY_MAX;
+        }
+      }
+      online = mqtt.connected();
+    }
+    telemetry.online = online;
+    if (online) mqtt.loop();
+
+    // Wait briefly for a line (not while a backlog is being sent), then take
+    // whatever else is queued
+    TickType_t wait = online && backlog.pos < backlog.size ? 0 : pdMS_TO_TICKS(200);
+    while (batch_count < TELEMETRY_BATCH_MAX &&
+           xQueueReceive(telemetry.queue, &batch[batch_count], wait) == pdTRUE) {
+      if (batch_count == 0) batch_start = millis();
+      batch_count++;
+      wait = 0;
+    }
+
+    // Offline: a full batch, or one that has waited long enough, is one SD append
+    if (!online) {
+      if (batch_count == TELEMETRY_BATCH_MAX ||
+          (batch_count > 0 && millis() - batch_start >= TELEMETRY_SPILL_DELAY)) {
+        telemetrySpill(backlog, batch, batch_count, payload, sizeof(payload));
+        batch_count = 0;
+      }
+      continue;
+    }
+
+    // Online: the backlog goes first, straight from the file; newer lines
+    // wait in the batch (and the queue) until it is sent
+    if (backlog.pos < backlog.size) {
+      int lines;
+      uint32_t taken;
+      size_t len = telemetryReadBacklog(backlog, payload, sizeof(payload), &lines, &taken);
+      if (taken == 0) {
+        vTaskDelay(pdMS_TO_TICKS(200)); // A read error, or nothing left; the queue waits meanwhile
+        continue;
+      }
+
+      if (mqtt.publish(topic, (const uint8_t *)payload, len)) {
+        backlog.pos += taken;
+        if (backlog.pos >= backlog.size) {
+          SD.remove(TELEMETRY_BACKLOG_PATH);
+          backlog.pos = backlog.size = 0;
+        }
+        telemetryBacklogChanged(backlog);
+        portENTER_CRITICAL(&telemetry.mux);
+        telemetry.counters.drained += lines;
+        telemetry.counters.published += lines;
+        telemetry.counters.batches++;
+        telemetry.counters.publish_bytes += len;
+        portEXIT_CRITICAL(&telemetry.mux);
+      } else {
+        mqtt.disconnect();
+      }
+      continue;
+    }
+
+    if (batch_count == 0) continue;
+
+    size_t len = 0;
+    for (int i = 0; i < batch_count; i++) {
+      len += snprintf(payload + len, sizeof(payload) - len, i ? "\n%s" : "%s", batch[i].text);
+      if (len >= sizeof(payload)) len = sizeof(payload) - 1;
+    }
+
+    // A failed publish keeps the batch: it is sent on reconnect or spilled
+    if (mqtt.publish(topic, (const uint8_t *)payload, len)) {
+      portENTER_CRITICAL(&telemetry.mux);
+      telemetry.counters.published += batch_count;
+      telemetry.counters.batches++;
+      telemetry.counters.publish_bytes += len;
+      portEXIT_CRITICAL(&telemetry.mux);
+      batch_count = 0;
+    } else {
+      mqtt.disconnect();
+    }
+  }
+}
+#endif
+
+// Counts since the previous report, swapped out under the lock
+void reportTelemetryStats() {
+#if TELEMETRY
+  if (telemetry.queue == NULL) return;
+
+  unsigned long window_s = (millis() - telemetry.report_start) / 1000;
+  if (window_s == 0) window_s = 1;
+  telemetry.report_start = millis();
+
+  TelemetryCounters counts;
+  portENTER_CRITICAL(&telemetry.mux);
+  counts = telemetry.counters;
+  telemetry.counters = TelemetryCounters();
+  uint32_t backlog_bytes = telemetry.backlog_bytes;
+  portEXIT_CRITICAL(&telemetry.mux);
+
+  reportf("[telemetry] online=%d published=%u batches=%u rate=%lu B/s queued=%u spilled=%u spill_writes=%u drained=%u dropped=%u backlog=%u B lost=%u B\n",
+    telemetry.online, (unsigned)counts.published, (unsigned)counts.batches,
+    counts.publish_bytes / window_s, (unsigned)counts.queued, (unsigned)counts.spilled,
+    (unsigned)counts.spill_writes, (unsigned)counts.drained, (unsigned)counts.dropped, (unsigned)backlog_bytes,
+    (unsigned)counts.lost_bytes);
+#endif
+}
+
+// Benchmarks
+// One CSV line per result: bench,<name>,<param>,<iterations>,<ns_per_op>
+#if STATION_BENCH
+static void benchResult(const char *name, long param, uint32_t iterations, int64_t elapsed_us) {
+  Serial.printf("bench,%s,%ld,%u,%lu\n", name, param, (unsigned)iterations,
+    (unsigned long)(elapsed_us * 1000 / iterations));
+  Serial.flush(); // Out of the UART before the next measurement starts
+  esp_task_wdt_reset();
+}
+
+static void benchFormatUID(int uid_size) {
+  const uint32_t iterations = 10000;
+  MFRC522::Uid uid;
+  uid.size = uid_size;
+  for (int i = 0; i < uid_size; i++) uid.uidByte[i] = 0x0F + i * 0x21;
+
+  char out[MAX_UID_LEN];
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) {
+    uid.uidByte[0] = (uint8_t)i;
+    formatUID(uid, out, sizeof(out));
+  }
+  benchResult("format_uid", uid_size, iterations, esp_timer_get_time() - start);
+}
+
+// Linear list lookup, worst case hit (last card) and miss
+static void benchCardList(int count) {
+  const uint32_t iterations = 2000;
+  static Card saved[MAX_CARDS];
+  memcpy(saved, cardList, sizeof(saved));
+  int saved_count = cardCount;
+  bool saved_index = card_index.available;
+  card_index.available = false;
+
+  for (int i = 0; i < count; i++) {
+    snprintf(cardList[i].uid, MAX_UID_LEN, "%08x", 0x10000000 + i * 7919);
+    cardList[i].policy = DEFAULT_POLICY;
+  }
+  cardCount = count;
+
+  char hit[MAX_UID_LEN];
+  strncpy(hit, cardList[count - 1].uid, MAX_UID_LEN);
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) isUID_Registered(hit);
+  benchResult("registered_list_hit", count, iterations, esp_timer_get_time() - start);
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) isUID_Registered("ffffffff");
+  benchResult("registered_list_miss", count, iterations, esp_timer_get_time() - start);
+
+  memcpy(cardList, saved, sizeof(saved));
+  cardCount = saved_count;
+  card_index.available = saved_index;
+}
+
+// Index lookups go through the Bloom filter and the SD block cache
+static void benchCardIndex() {
+  if (!card_index.available) return;
+
+  const uint32_t iterations = 200;
+  char uid[MAX_UID_LEN];
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) {
+    snprintf(uid, sizeof(uid), "%08x", (unsigned)(0x20000000 + i * 104729));
+    isUID_Registered(uid);
+  }
+  benchResult("registered_index_miss", card_index.record_count, iterations, esp_timer_get_time() - start);
+}
+
+// Every slot taken: both scans run to the end
+static void benchSlots() {
+  const uint32_t iterations = 10000;
+  char saved[SLOT_COUNT][MAX_UID_LEN];
+  memcpy(saved, uid_lists, sizeof(saved));
+  for (int i = 0; i < SLOT_COUNT; i++) snprintf(uid_lists[i], MAX_UID_LEN, "bench%d", i);
+  int saved_index = current_uid_index;
+
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) isUID_UsingCharger("ffffffff");
+  benchResult("using_charger_miss", SLOT_COUNT, iterations, esp_timer_get_time() - start);
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) isSlotAvailable();
+  benchResult("slot_available_full", SLOT_COUNT, iterations, esp_timer_get_time() - start);
+
+  memcpy(uid_lists, saved, sizeof(saved));
+  current_uid_index = saved_index;
+}
+
+// SD reads and parsing; the per-card echo is off while serial_quiet is set
+static void benchCardListLoad() {
+  if (!sd_mounted || card_index.available) return;
+
+  const uint32_t iterations = 3;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) {
+    cardCount = 0;
+    loadCardList();
+    esp_task_wdt_reset();
+  }
+  benchResult("csv_load", cardCount, iterations, esp_timer_get_time() - start);
+}
+
+// One loop() pass per page with no input, screen work included. The page
+// state is put back afterwards; the scan screen and charger list redraw.
+static void benchPageSteps() {
+  const uint32_t iterations = 200;
+  Pages saved_page = current_page;
+  unsigned long saved_loading = loading_timer;
+  unsigned long saved_warning = warning_timer;
+  int saved_menu = menu_index;
+  int saved_uid_index = current_uid_index;
+  PolicyResult saved_policy = current_policy_result;
+
+  for (int page = SCAN_WAIT; page <= CARD_DENIED; page++) {
+    int64_t elapsed = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+      current_page = (Pages)page;
+      loading_timer = millis();
+      warning_timer = millis();
+      markActivity(); // Keeps SCAN_WAIT out of light sleep
+      int64_t start = esp_timer_get_time();
+      loop();
+      elapsed += esp_timer_get_time() - start;
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "page_step_%s", page_names[page]);
+    benchResult(name, page, iterations, elapsed);
+  }
+
+  current_page = saved_page;
+  loading_timer = saved_loading;
+  warning_timer = saved_warning;
+  menu_index = saved_menu;
+  current_uid_index = saved_uid_index;
+  current_policy_result = saved_policy;
+  isScanWaitShow = false;
+  last_menu_index = -1;
+}
+#endif
+
+void runBenchmarks() {
+#if STATION_BENCH
+  Serial.println("bench,name,param,iterations,ns_per_op");
+  Serial.flush();
+  serial_quiet = true;
+  benchFormatUID(4);
+  benchFormatUID(7);
+  benchFormatUID(10);
+  benchCardList(1);
+  benchCardList(MAX_CARDS / 4);
+  benchCardList(MAX_CARDS / 2);
+  benchCardList(MAX_CARDS);
+  benchCardIndex();
+  benchSlots();
+  benchCardListLoad();
+  benchPageSteps();
+  serial_quiet = false;
+  Serial.println("bench,done,0,0,0");
+#endif
+}
+
+// Usage analytics
+// Bookkeeping when a slot's session ends, by timeout or by the card owner
+void endSession(int slot) {
+  unsigned long elapsed = millis() - relays[slot].timer;
+  addCardUsage(uid_lists[slot], elapsed);
+  telemetryEvent("end", slot, uid_lists[slot], elapsed / 1000);
+  recordSession(slot, uid_lists[slot], elapsed);
+}
+
+// Folds one session into the slot and card aggregates
+static void applySession(const SessionRecord &record) {
+  if (record.slot >= SLOT_COUNT) return;
+
+  SlotStats &slot = analytics.slots[record.slot];
+  slot.sessions++;
+  slot.seconds += record.seconds;
+
+  // Spread the session over the local hours it covered
+  if (record.end != 0) {
+    long end = (long)record.end + TIME_UTC_OFFSET;
+    long t = end - (long)record.seconds;
+    while (t < end) {
+      long hour_end = (t / 3600 + 1) * 3600;
+      long chunk = (hour_end < end ? hour_end : end) - t;
+      slot.hour_seconds[(t / 3600) % 24] += chunk;
+      t += chunk;
+    }
+  }
+
+  if (record.uid[0] == '\0') return;
+
+  // Linear scan: the table is small and this runs once per session
+  CardStats *card = NULL;
+  CardStats *victim = &analytics.cards[0];
+  for (int i = 0; i < ANALYTICS_CARDS; i++) {
+    CardStats &entry = analytics.cards[i];
+    if (strcmp(entry.uid, record.uid) == 0) {
+      card = &entry;
+      break;
+    }
+    if (victim->uid[0] != '\0' && (entry.uid[0] == '\0' || entry.last_seq < victim->last_seq)) {
+      victim = &entry;
+    }
+  }
+
+  if (card == NULL) {
+    card = victim;
+    memset(card, 0, sizeof(*card));
+    strncpy(card->uid, record.uid, MAX_UID_LEN - 1);
+  }
+
+  card->sessions++;
+  card->seconds += record.seconds;
+  card->last_seq = record.seq;
+  if (record.end != 0) card->last_use = record.end;
+  if (card->slot_sessions[record.slot] < 0xFFFF) card->slot_sessions[record.slot]++;
+}
+
+void recordSession(int slot, const char *uid, unsigned long elapsed_ms) {
+  SessionRecord record;
+  memset(&record, 0, sizeof(record));
+  strncpy(record.uid, uid, MAX_UID_LEN - 1);
+  record.seq = ++analytics_seq;
+  record.end = isClockValid() ? (uint32_t)time(NULL) : 0;
+  record.seconds = elapsed_ms / 1000;
+  record.slot = slot;
+  applySession(record);
+
+  if (!sd_mounted) return;
+
+  PeripheralScope scope(PERIPH_SD);
+  File file = SD.open(ANALYTICS_JOURNAL_PATH, FILE_APPEND);
+  if (!file) {
+    Serial.println("Failed to write analytics.log");
+    return;
+  }
+  file.write((const uint8_t *)&record, sizeof(record));
+  file.close();
+  journal_records++;
+}
+
+// Snapshot first, then the journal entries it does not contain yet
+void loadAnalytics() {
+  PeripheralScope scope(PERIPH_SD);
+  memset(&analytics, 0, sizeof(analytics));
+
+  // A compaction interrupted after writing the new snapshot left it under the temporary name
+  if (!SD.exists(ANALYTICS_PATH) && SD.exists(ANALYTICS_TMP_PATH)) {
+    SD.rename(ANALYTICS_TMP_PATH, ANALYTICS_PATH);
+  }
+
+  File file = SD.open(ANALYTICS_PATH);
+  if (file) {
+    if (file.read((uint8_t *)&analytics, sizeof(analytics)) != sizeof(analytics) ||
+        analytics.header.magic != ANALYTICS_MAGIC || analytics.header.slot_count != SLOT_COUNT ||
+        analytics.header.card_count != ANALYTICS_CARDS) {
+      Serial.println("Ignoring invalid analytics.bin");
+      memset(&analytics, 0, sizeof(analytics));
+    }
+    file.close();
+  }
+
+  analytics.header.magic = ANALYTICS_MAGIC;
+  analytics.header.slot_count = SLOT_COUNT;
+  analytics.header.card_count = ANALYTICS_CARDS;
+  analytics_seq = analytics.header.seq;
+
+  file = SD.open(ANALYTICS_JOURNAL_PATH);
+  if (file) {
+    SessionRecord record;
+    while (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+      journal_records++;
+      if (record.seq <= analytics.header.seq) continue; // Already in the snapshot
+      record.uid[MAX_UID_LEN - 1] = '\0';
+      applySession(record);
+      if (record.seq > analytics_seq) analytics_seq = record.seq;
+    }
+    file.close();
+  }
+
+  analytics_compact_timer = millis();
+}
+
+// Writes the aggregates as a new snapshot and starts an empty journal
+void compactAnalytics() {
+  analytics_compact_timer = millis();
+  if (!sd_mounted) {
+    journal_records = 0;
+    return;
+  }
+
+  PeripheralScope scope(PERIPH_SD);
+  analytics.header.seq = analytics_seq;
+
+  File file = SD.open(ANALYTICS_TMP_PATH, FILE_WRITE);
+  if (!file) {
+    Serial.println("Failed to write analytics.tmp");
+    return;
+  }
+  bool written = file.write((const uint8_t *)&analytics, sizeof(analytics)) == sizeof(analytics);
+  file.close();
+  if (!written) return;
+
+  // The snapshot carries its sequence number, so a journal that survives a
+  // reset here is skipped on load instead of being counted twice
+  SD.remove(ANALYTICS_PATH);
+  SD.rename(ANALYTICS_TMP_PATH, ANALYTICS_PATH);
+  SD.remove(ANALYTICS_JOURNAL_PATH);
+  journal_records = 0;
+}
+
+// Seconds as minutes with one decimal
+static int formatMinutes(char *out, size_t len, uint32_t seconds) {
+  return snprintf(out, len, "%lu.%lu", (unsigned long)(seconds / 60), (unsigned long)(seconds % 60 / 6));
+}
+
+// Formats the next export row, false when the export is done
+static bool nextExportRow() {
+  char *row = command.row;
+  size_t size = sizeof(command.row);
+  int len = 0;
+
+  if (command.export_kind == EXPORT_CARDS) {
+    if (command.export_index < 0) {
+      len = snprintf(row, size, "uid,sessions,minutes,last_use");
+      for (int i = 0; i < SLOT_COUNT; i++) len += snprintf(row + len, size - len, ",slot%d", i);
+    } else {
+      // Skip free entries
+      while (command.export_index < ANALYTICS_CARDS && analytics.cards[command.export_index].uid[0] == '\0') {
+        command.export_index++;
+      }
+      if (command.export_index >= ANALYTICS_CARDS) return false;
+
+      const CardStats &card = analytics.cards[command.export_index];
+      len = snprintf(row, size, "%s,%lu,", card.uid, (unsigned long)card.sessions);
+      len += formatMinutes(row + len, size - len, card.seconds);
+      len += snprintf(row + len, size - len, ",%lu", (unsigned long)card.last_use);
+      for (int i = 0; i < SLOT_COUNT; i++) len += snprintf(row + len, size - len, ",%u", card.slot_sessions[i]);
+    }
+  } else if (command.export_kind == EXPORT_SLOTS) {
+    if (command.export_index < 0) {
+      len = snprintf(row, size, "slot,name,sessions,minutes");
+      for (int h = 0; h < 24; h++) len += snprintf(row + len, size - len, ",h%02d", h);
+    } else {
+      if (command.export_index >= SLOT_COUNT) return false;
+
+      const SlotStats &slot = analytics.slots[command.export_index];
+      len = snprintf(row, size, "%d,%s,%lu,", command.export_index, SLOTS[command.export_index].name,
+        (unsigned long)slot.sessions);
+      len += formatMinutes(row + len, size - len, slot.seconds);
+      for (int h = 0; h < 24; h++) {
+        len += snprintf(row + len, size - len, ",");
+        len += formatMinutes(row + len, size - len, slot.hour_seconds[h]);
+      }
+    }
+  } else {
+    return false;
+  }
+
+  len += snprintf(row + len, size - len, "\n");
+  command.row_length = len < (int)size ? len : (int)size - 1;
+  command.row_sent = 0;
+  command.export_index++;
+  return true;
+}
+
+// Reads commands and streams exports a piece per pass, only as much as the
+// UART can take without waiting. Periodic reports wait until an export ends.
+void serialCommandStep() {
+  if (command.export_kind != EXPORT_NONE) {
+    if (command.row_sent >= command.row_length && !nextExportRow()) {
+      command.export_kind = EXPORT_NONE;
+      serial_quiet = false;
+      return;
+    }
+
+    int room = Serial.availableForWrite();
+    int left = command.row_length - command.row_sent;
+    int chunk = left < room ? left : room;
+    if (chunk > 0) {
+      Serial.write((const uint8_t *)command.row + command.row_sent, chunk);
+      command.row_sent += chunk;
+    }
+    return; // Input waits until the export is done
+  }
+
+  for (int n = 0; n < COMMAND_LEN && Serial.available() > 0; n++) {
+    char c = Serial.read();
+    command.rx_timer = millis();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (command.length < COMMAND_LEN - 1) command.line[command.length++] = c;
+      continue;
+    }
+
+    command.line[command.length] = '\0';
+    command.length = 0;
+
+    if (strcmp(command.line, "export cards") == 0) {
+      command.export_kind = EXPORT_CARDS;
+    } else if (strcmp(command.line, "export slots") == 0) {
+      command.export_kind = EXPORT_SLOTS;
+    } else if (strncmp(command.line, "time ", 5) == 0) {
+      // Seconds since 1970 UTC, e.g. from `date +%s` on the host
+      char *end;
+      unsigned long epoch = strtoul(command.line + 5, &end, 10);
+      struct timeval now = {(time_t)epoch, 0};
+      if (*end != '\0' || (time_t)epoch <= CLOCK_VALID_AFTER || settimeofday(&now, NULL) != 0) {
+        Serial.println("Usage: time <seconds since 1970 UTC>");
+      } else {
+        Serial.printf("Clock set to %lu\n", epoch);
+      }
+      continue;
+    } else if (command.line[0] != '\0') {
+      Serial.println("Commands: export cards | export slots | time <epoch>");
+      continue;
+    }
+
+    command.export_index = -1;
+    command.row_length = command.row_sent = 0;
+    serial_quiet = true;
+    return;
+  }
+}
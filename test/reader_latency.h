@@ -0,0 +1,78 @@
+#pragma once
+
+// Tap-to-detection latency with BOARD_READER_SIM readers (the table in
+// reader_sim_readers.h), shared by the test_reader_latency_<n> suites.
+// Polls take their MFRC522 time (fakeReaderTiming): every idle reader costs a
+// 25 ms REQA timeout, so a round over all readers grows with their number.
+
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+// Resolved from include/, where board_profile.h includes it
+#define BOARD_READERS_FILE "../test/reader_sim_readers.h"
+
+#include "../src/main.cpp"
+#include "station_sim.h"
+
+const int LATENCY_SAMPLES = 200;
+const unsigned long REQA_TIMEOUT_MS = 25;
+
+void setUp() {}
+void tearDown() {}
+
+// Taps a fresh unknown card on a reader at a random moment, returns the time
+// until the station leaves the scan screen
+unsigned long measureTap(int sample) {
+  runFor(rand() % 1000);
+
+  // runFor() stops right after a pass, the tap lands anywhere in the next one
+  const uint8_t uid[] = {0xf0, (uint8_t)(sample >> 8), (uint8_t)sample, 0x01};
+  uint8_t ss_pin = READERS[sample % READER_COUNT].ss_pin;
+  unsigned long tapped = millis() + rand() % (READER_COUNT * REQA_TIMEOUT_MS + READER_POLL_MAX);
+  fakeScheduleTap(tapped, ss_pin, uid, sizeof(uid));
+
+  while (current_page == SCAN_WAIT && (long)(millis() - tapped) < 5000) {
+    uint64_t before = fakeNowUs();
+    loop();
+    if (fakeNowUs() == before) fakeAdvance(1);
+  }
+  unsigned long latency = millis() - tapped;
+
+  fakeCardRemove(ss_pin);
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+  return latency;
+}
+
+void test_tap_latency() {
+  std::vector<unsigned long> latencies;
+  for (int sample = 0; sample < LATENCY_SAMPLES; sample++) {
+    latencies.push_back(measureTap(sample));
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  unsigned long p50 = latencies[LATENCY_SAMPLES / 2];
+  unsigned long p95 = latencies[LATENCY_SAMPLES * 95 / 100];
+  unsigned long p99 = latencies[LATENCY_SAMPLES * 99 / 100];
+  unsigned long max = latencies.back();
+  printf("[readers] %d readers: tap latency p50=%lu ms p95=%lu ms p99=%lu ms max=%lu ms\n",
+    READER_COUNT, p50, p95, p99, max);
+
+  // A round of idle polls over every reader, then the tapped reader's
+  // backoff, plus the read itself. The periodic reports go out a UART FIFO
+  // at a time, so no tap waits for them to drain.
+  TEST_ASSERT_LESS_OR_EQUAL(READER_COUNT * REQA_TIMEOUT_MS + READER_POLL_MAX + 20, p99);
+  TEST_ASSERT_LESS_OR_EQUAL(READER_COUNT * REQA_TIMEOUT_MS + READER_POLL_MAX + 40, max);
+}
+
+int main() {
+  srand(36);
+  bootStation(NULL);
+  fakeReaderTiming(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_tap_latency);
+  return UNITY_END();
+}
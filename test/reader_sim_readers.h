@@ -0,0 +1,14 @@
+// Host simulation only, included by include/board_profile.h through
+// BOARD_READERS_FILE (see reader_latency.h): the front panel reader plus
+// BOARD_READER_SIM - 1 bay readers on chip selects past the GPIO range
+constexpr ReaderConfig READERS[] = {
+  {RFID_SS, RFID_RST, -1},
+  {40, RFID_RST, 0}, {41, RFID_RST, 1}, {42, RFID_RST, 2},
+#if BOARD_READER_SIM > 4
+  {43, RFID_RST, 3}, {44, RFID_RST, 0}, {45, RFID_RST, 1}, {46, RFID_RST, 2},
+#endif
+#if BOARD_READER_SIM > 8
+  {47, RFID_RST, 3}, {48, RFID_RST, 0}, {49, RFID_RST, 1}, {50, RFID_RST, 2},
+  {51, RFID_RST, 3}, {52, RFID_RST, 0}, {53, RFID_RST, 1}, {54, RFID_RST, 2},
+#endif
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+// Render cost of every screen against render_baselines[], shared by
+// test_render_cost (pre-rendered images) and test_render_cost_drawn
+// (USE_SCREEN_IMAGES=0). RecordingTFT counts what each screen sends over SPI
+// on the framebuffer fake, the firmware flags a screen more than
+// COST_REGRESSION_PERCENT over its baseline, and that fails the suite.
+//
+// Every screen is also saved as a PNG, to $RENDER_SNAPSHOT_DIR or a fresh
+// directory under /tmp, so a change in cost can be looked at.
+
+#define RENDER_COST 1
+
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+
+#include "../src/main.cpp"
+#include "station_sim.h"
+
+const uint8_t LONG_UID[] = {0x04, 0xa1, 0xb2, 0xc3, 0xd4, 0xe5, 0xf6};  // 7-byte UID, the longest line
+
+std::string snapshot_dir;
+std::map<std::string, RenderCost> worst;  // Per screen, the costliest language and argument
+uint32_t snapshots = 0;
+
+void setUp() {}
+void tearDown() {}
+
+// Draws one screen through its display function, waits for the render queue
+// to drain and keeps the cost and a snapshot under name (with variant)
+template <typename Display>
+void measure(const char *name, const char *variant, Display display) {
+  display();
+  do {
+    renderStep();
+  } while (render_cost.screen != NULL);
+
+  TEST_ASSERT_NOT_NULL_MESSAGE(findBaseline(name), name);
+  RenderCost &screen_worst = worst[name];
+  if (render_cost.spi_bytes > screen_worst.spi_bytes) screen_worst = render_cost;
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s_%d%s%s.png", snapshot_dir.c_str(), name, (int)current_language,
+    variant[0] != '\0' ? "_" : "", variant);
+  if (fakeTftSavePng(path)) snapshots++;
+}
+
+void setSlots(bool on) {
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    relays[i].state = on;
+    relays[i].timer = millis();
+    snprintf(uid_lists[i], MAX_UID_LEN, on ? "c0ffee%02x" : "", i);
+  }
+}
+
+void measureLanguage() {
+  for (int on = 0; on <= 1; on++) {
+    setSlots(on);
+    const char *variant = on ? "charging" : "idle";
+    measure("scan_wait", variant, [] {
+      isScanWaitShow = false;
+      displayScanWaitMenu();
+    });
+    measure("charger_list", variant, [] {
+      last_menu_index = -1;
+      menu_index = 0;
+      displayChargerList();
+    });
+  }
+  setSlots(false);
+
+  measure("scan_ok", "uid4", [] { displayScanOK_Menu("a1b2c3d4"); });
+  measure("scan_ok", "uid7", [] {
+    char uid[MAX_UID_LEN];
+    MFRC522::Uid long_uid = {};
+    long_uid.size = sizeof(LONG_UID);
+    memcpy(long_uid.uidByte, LONG_UID, sizeof(LONG_UID));
+    formatUID(long_uid, uid, sizeof(uid));
+    displayScanOK_Menu(uid);
+  });
+
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    char variant[16];
+    snprintf(variant, sizeof(variant), "slot%d", i);
+    measure("enable_conf", variant, [i] {
+      menu_index = i;
+      displayChargerEnableConf();
+    });
+    measure("disable_conf", variant, [i] {
+      current_uid_index = i;
+      displayChargerDisableConf();
+    });
+  }
+
+  measure("unauthorized", "", [] { displayUnauthorizedCard(); });
+  measure("enable_success", "", [] { displayChargerEnableSuccess(); });
+  measure("disable_success", "", [] { displayChargerDisableSuccess(); });
+  measure("logout", "", [] { displayLogoutMenu(); });
+  measure("charger_full", "", [] { displayChargerFull(); });
+
+  const PolicyResult denied[] = {POLICY_BLOCKED, POLICY_EXPIRED, POLICY_QUOTA_USED};
+  const char *denied_names[] = {"blocked", "expired", "quota"};
+  for (int i = 0; i < 3; i++) {
+    measure("card_denied", denied_names[i], [&] {
+      current_policy_result = denied[i];
+      displayCardDenied();
+    });
+  }
+
+  if (HAS_DOOR_LOCK) {
+    measure("door_lock", "remove", [] { displayDoorLockWaitMenu(); });
+    relays[HAS_DOOR_LOCK ? DOOR_LOCK_SLOT : 0].state = true;
+    measure("door_lock", "insert", [] { displayDoorLockWaitMenu(); });
+    relays[HAS_DOOR_LOCK ? DOOR_LOCK_SLOT : 0].state = false;
+  }
+}
+
+void test_screens_within_baseline() {
+  for (int lang = 0; lang < LANG_COUNT; lang++) {
+    current_language = (Language)lang;
+    measureLanguage();
+  }
+
+  for (int i = 0; render_baselines[i].screen != NULL; i++) {
+    const RenderBaseline &baseline = render_baselines[i];
+    TEST_ASSERT_TRUE_MESSAGE(worst.count(baseline.screen) != 0, baseline.screen);
+    const RenderCost &cost = worst[baseline.screen];
+    printf("[cost] %-16s worst px=%u spi=%u calls=%u, baseline spi=%u\n", baseline.screen,
+      (unsigned)cost.pixels, (unsigned)cost.spi_bytes, (unsigned)cost.calls, (unsigned)baseline.spi_bytes);
+  }
+  printf("[cost] %u snapshots in %s\n", (unsigned)snapshots, snapshot_dir.c_str());
+
+  TEST_ASSERT_EQUAL_UINT32(0, render_cost.regressions);
+}
+
+int main() {
+  const char *dir = getenv("RENDER_SNAPSHOT_DIR");
+  char fresh[] = "/tmp/render_snapshots_XXXXXX";
+  snapshot_dir = dir != NULL ? dir : (mkdtemp(fresh) != NULL ? fresh : ".");
+
+  bootStation(NULL);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_screens_within_baseline);
+  return UNITY_END();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Drives the firmware included by a test suite (../../src/main.cpp) on the
+// host fakes: runs loop() against the fake clock and scripts card taps and
+// button presses the way a user would make them.
+
+#include "host_fakes.h"
+
+// Runs loop() until the fake clock reaches millis() + ms. A pass that did not
+// move the clock (no sleep, no delay) is charged one millisecond.
+inline void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    uint64_t before = fakeNowUs();
+    loop();
+    if (fakeNowUs() == before) fakeAdvance(1);
+  }
+}
+
+// Card held on the reader for 500 ms, starting at the next loop pass
+inline void tapCard(const uint8_t *uid, uint8_t size, uint8_t ss_pin = RFID_SS) {
+  fakeScheduleTap(millis(), ss_pin, uid, size);
+  fakeScheduleRemove(millis() + 500, ss_pin);
+}
+
+// Button held low for 100 ms, well past the 25 ms debounce
+inline void pressButton(uint8_t pin) {
+  fakeSchedulePin(millis(), pin, LOW);
+  fakeSchedulePin(millis() + 100, pin, HIGH);
+  runFor(200);
+}
+
+// Boots the firmware once per test binary with the given card list on the SD card
+inline void bootStation(const char *card_list) {
+  fakeSdRoot();
+  if (card_list != NULL) fakeSdWrite("/card_list.csv", card_list);
+  setup();
+}
@@ -0,0 +1,139 @@
+// The boot microbenchmarks (STATION_BENCH=1): one line per result, the timed
+// sections free of Serial output (no card list echo, no periodic reports) and
+// the page state left as it was found. They run on the host's clock, and with
+// a card list 20 times the firmware's so the list sweep shows its growth.
+// Slot scans stay at the board's SLOT_COUNT.
+
+#define STATION_BENCH 1
+#define MAX_CARDS 1000
+
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const char CARD_LIST[] =
+  "a1b2c3d4,Bench User One\n"
+  "12345678,Bench User Two\n"
+  "deadbeef,Bench User Three\n";
+
+std::string boot_output;
+
+void setUp() {}
+void tearDown() {}
+
+// The benchmark lines of an output, header to done
+std::string benchLines(const std::string &output) {
+  size_t start = output.find("bench,name,");
+  size_t end = output.find("bench,done,");
+  if (start == std::string::npos || end == std::string::npos) return "";
+  return output.substr(start, end - start);
+}
+
+// ns_per_op of the named result (of the first one without a param), -1 when
+// it is missing
+long nsPerOp(const std::string &lines, const char *name, long param = -1) {
+  std::string key = std::string("bench,") + name + ",";
+  if (param >= 0) key += std::to_string(param) + ",";
+  size_t at = lines.find(key);
+  if (at == std::string::npos) return -1;
+  size_t end = lines.find('\n', at);
+  std::string line = lines.substr(at, end - at);
+  return atol(line.substr(line.rfind(',') + 1).c_str());
+}
+
+void test_every_benchmark_reports() {
+  std::string lines = benchLines(boot_output);
+  // Timed on the host's clock, none of them can come out at zero
+  const char *names[] = {"format_uid", "registered_list_hit", "registered_list_miss", "using_charger_miss",
+    "slot_available_full", "csv_load"};
+  for (const char *name : names) TEST_ASSERT_TRUE_MESSAGE(nsPerOp(lines, name) > 0, name);
+
+  for (int page = SCAN_WAIT; page <= CARD_DENIED; page++) {
+    std::string name = std::string("page_step_") + page_names[page];
+    TEST_ASSERT_TRUE_MESSAGE(nsPerOp(lines, name.c_str()) >= 0, name.c_str());
+  }
+}
+
+// A linear scan: the whole list costs far more than one card. Best of three
+// runs, a host thread can be preempted in the middle of a short one.
+void test_list_sweep_grows_with_the_list() {
+  std::vector<std::string> runs = {benchLines(boot_output)};
+  for (int i = 0; i < 2; i++) {
+    fakeSerialOutput();
+    fakeRealTimer(true);
+    runBenchmarks();
+    fakeRealTimer(false);
+    runs.push_back(benchLines(fakeSerialOutput()));
+  }
+  long one = -1, all = -1;
+  for (const std::string &lines : runs) {
+    long n = nsPerOp(lines, "registered_list_miss", 1);
+    long m = nsPerOp(lines, "registered_list_miss", MAX_CARDS);
+    if (one < 0 || n < one) one = n;
+    if (all < 0 || m < all) all = m;
+  }
+  printf("[bench] registered_list_miss: %ld ns at 1 card, %ld ns at %d\n", one, all, MAX_CARDS);
+  TEST_ASSERT_TRUE(one > 0);
+  TEST_ASSERT_GREATER_THAN(one * 10, all);
+}
+
+void test_csv_load_leaves_out_the_echo() {
+  std::string lines = benchLines(boot_output);
+  TEST_ASSERT_EQUAL(std::string::npos, lines.find("UID: "));
+  TEST_ASSERT_EQUAL(std::string::npos, lines.find("Card list loaded."));
+
+  // At 9600 baud one echoed card line alone would take over 20 ms
+  long csv_load = nsPerOp(lines, "csv_load");
+  TEST_ASSERT_TRUE(csv_load >= 0);
+  TEST_ASSERT_LESS_THAN(1000000L, csv_load);
+
+  TEST_ASSERT_EQUAL(3, cardCount);
+  TEST_ASSERT_EQUAL_STRING("deadbeef", cardList[2].uid);
+}
+
+void test_page_steps_restore_state_and_hold_reports() {
+  current_page = CHOOSE_CHARGER;
+  menu_index = 1;
+  current_uid_index = 2;
+  current_policy_result = POLICY_EXPIRED;
+  loading_timer = 1234;
+  heap_stats.report_timer = millis() - HEAP_REPORT_INTERVAL; // A report is due
+  fakeSerialOutput();
+
+  fakeRealTimer(true);
+  runBenchmarks();
+  fakeRealTimer(false);
+  std::string output = fakeSerialOutput();
+  TEST_ASSERT_TRUE(benchLines(output).size() > 0);
+  TEST_ASSERT_EQUAL(std::string::npos, output.find("[heap]"));
+
+  TEST_ASSERT_EQUAL(CHOOSE_CHARGER, current_page);
+  TEST_ASSERT_EQUAL(1, menu_index);
+  TEST_ASSERT_EQUAL(2, current_uid_index);
+  TEST_ASSERT_EQUAL(POLICY_EXPIRED, current_policy_result);
+  TEST_ASSERT_EQUAL_UINT32(1234, loading_timer);
+
+  // The held report goes out on the next pass
+  loop();
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, fakeSerialOutput().find("[heap]"));
+}
+
+int main() {
+  fakeRealTimer(true);
+  bootStation(CARD_LIST);
+  fakeRealTimer(false);
+  boot_output = fakeSerialOutput();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_every_benchmark_reports);
+  RUN_TEST(test_list_sweep_grows_with_the_list);
+  RUN_TEST(test_csv_load_leaves_out_the_echo);
+  RUN_TEST(test_page_steps_restore_state_and_hold_reports);
+  return UNITY_END();
+}
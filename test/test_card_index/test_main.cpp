@@ -0,0 +1,173 @@
+// Card index at fleet size: 100k cards from scripts/gen_card_fixture.py,
+// indexed by scripts/build_card_index.py. Lookup time comes from the SD
+// fake's transfer model (see fake_sd.cpp), not from a board.
+
+#include <unity.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const int FLEET_SIZE = 100000;
+const int SAMPLE_SIZE = 2000;
+
+std::vector<std::string> known_uids;
+std::vector<std::string> unknown_uids;
+
+void setUp() {}
+void tearDown() {}
+
+// Runs one of the scripts/ generators, with python3 or python
+bool runScript(const std::string &args) {
+  std::string dir = __FILE__;
+  dir = dir.substr(0, dir.find_last_of('/') + 1) + "../../scripts/";
+  std::string cmd = "python3 " + dir + args + " > /dev/null";
+  if (system(cmd.c_str()) == 0) return true;
+  cmd = "python " + dir + args + " > /dev/null";
+  return system(cmd.c_str()) == 0;
+}
+
+void buildFleet() {
+  std::string csv = fakeSdPath("/card_list.csv");
+  std::string bin = fakeSdPath(CARD_INDEX_PATH);
+  if (!runScript("gen_card_fixture.py " + std::to_string(FLEET_SIZE) + " " + csv) ||
+      !runScript("build_card_index.py " + csv + " " + bin)) {
+    return;
+  }
+
+  // Every 50th card is looked up; unknown UIDs are drawn from the same space
+  std::set<std::string> fleet;
+  std::string list = fakeSdRead("/card_list.csv");
+  size_t at = 0;
+  while (at < list.size()) {
+    size_t comma = list.find(',', at);
+    size_t end = list.find('\n', at);
+    std::string uid = list.substr(at, comma - at);
+    fleet.insert(uid);
+    if (fleet.size() % (FLEET_SIZE / SAMPLE_SIZE) == 0) known_uids.push_back(uid);
+    at = end == std::string::npos ? list.size() : end + 1;
+  }
+
+  srand(7);
+  while ((int)unknown_uids.size() < SAMPLE_SIZE) {
+    char uid[MAX_UID_LEN];
+    snprintf(uid, sizeof(uid), "%x%x%x%x", rand() & 0xff, rand() & 0xff, rand() & 0xff, rand() & 0xff);
+    if (!fleet.count(uid)) unknown_uids.push_back(uid);
+  }
+}
+
+uint32_t percentile(std::vector<uint32_t> values, int percent) {
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * percent / 100];
+}
+
+void test_index_loads() {
+  TEST_ASSERT_TRUE(card_index.available);
+  TEST_ASSERT_EQUAL_UINT32(FLEET_SIZE, card_index.record_count);
+
+  uint32_t filter_bytes = (card_index.bloom_bits + 7) / 8;
+  uint32_t load_ms = (boot_timings[BOOT_CARDS].end - boot_timings[BOOT_CARDS].start) / 1000;
+  printf("[card_index] RAM: %u B index state + %u B filter = %u B, boot load %u ms\n",
+    (unsigned)sizeof(CardIndex), (unsigned)filter_bytes, (unsigned)(sizeof(CardIndex) + filter_bytes), (unsigned)load_ms);
+
+  // 8 bits per card would be 100 KB, about all of the largest free block:
+  // the filter stops at the cap
+  TEST_ASSERT_NOT_NULL(card_index.bloom);
+  TEST_ASSERT_EQUAL_UINT32(CARD_BLOOM_MAX_BYTES, filter_bytes);
+}
+
+void test_known_cards_are_found() {
+  std::vector<uint32_t> reads, micros_taken;
+  for (const std::string &uid : known_uids) {
+    uint32_t reads_before = card_index.sd_reads;
+    uint64_t start = fakeNowUs();
+    CardRecord record;
+    TEST_ASSERT_TRUE(findCardRecord(uid.c_str(), &record));
+    TEST_ASSERT_EQUAL_STRING(uid.c_str(), record.uid);
+    reads.push_back(card_index.sd_reads - reads_before);
+    micros_taken.push_back((uint32_t)(fakeNowUs() - start));
+  }
+
+  printf("[card_index] known: SD reads p50=%u p99=%u max=%u, lookup p50=%u us p99=%u us\n",
+    (unsigned)percentile(reads, 50), (unsigned)percentile(reads, 99), (unsigned)card_index.max_sd_reads,
+    (unsigned)percentile(micros_taken, 50), (unsigned)percentile(micros_taken, 99));
+
+  // One fence group of at most 49 blocks: log2(49) + 1 block reads
+  TEST_ASSERT_LESS_OR_EQUAL(7, card_index.max_sd_reads);
+  TEST_ASSERT_LESS_OR_EQUAL(10000, percentile(micros_taken, 99));
+}
+
+// Share of the unknown sample the filter lets through to SD
+double falsePositivePercent() {
+  uint32_t rejects_before = card_index.bloom_rejects;
+  for (const std::string &uid : unknown_uids) TEST_ASSERT_FALSE(findCardRecord(uid.c_str(), NULL));
+  return 100.0 * (SAMPLE_SIZE - (card_index.bloom_rejects - rejects_before)) / SAMPLE_SIZE;
+}
+
+void test_unknown_cards_are_rejected() {
+  uint32_t rejects_before = card_index.bloom_rejects;
+  std::vector<uint32_t> micros_taken;
+  for (const std::string &uid : unknown_uids) {
+    uint64_t start = fakeNowUs();
+    TEST_ASSERT_FALSE(findCardRecord(uid.c_str(), NULL));
+    micros_taken.push_back((uint32_t)(fakeNowUs() - start));
+  }
+
+  uint32_t passed = SAMPLE_SIZE - (card_index.bloom_rejects - rejects_before);
+  printf("[card_index] unknown: filter false positives %u/%u (%.2f%%), lookup p99=%u us\n",
+    (unsigned)passed, (unsigned)SAMPLE_SIZE, 100.0 * passed / SAMPLE_SIZE, (unsigned)percentile(micros_taken, 99));
+
+  // 80 KB for 100k cards is 6.5 bits per card, with 5 hashes about 4.5% expected
+  TEST_ASSERT_LESS_OR_EQUAL(SAMPLE_SIZE * 6 / 100, passed);
+}
+
+void test_small_heap_keeps_a_smaller_filter() {
+  card_index.file.close();
+  card_index.available = false;
+  free(card_index.bloom);
+
+  fakeHeapLargestBlock(40000);
+  TEST_ASSERT_TRUE(loadCardIndex());
+  fakeHeapLargestBlock(110000);
+
+  uint32_t filter_bytes = card_index.bloom_bits / 8;
+  TEST_ASSERT_NOT_NULL(card_index.bloom);
+  TEST_ASSERT_EQUAL_UINT32(40000 - CARD_BLOOM_HEAP_MARGIN, filter_bytes);
+  TEST_ASSERT_EQUAL(1, card_index.bloom_hashes);
+
+  // 1.9 bits per card and one hash: more unknown cards reach SD, no known card is lost
+  double passed = falsePositivePercent();
+  printf("[card_index] %u B filter: false positives %.2f%%\n", (unsigned)filter_bytes, passed);
+  TEST_ASSERT_TRUE(passed < 50);
+  for (const std::string &uid : known_uids) TEST_ASSERT_TRUE(findCardRecord(uid.c_str(), NULL));
+}
+
+void test_tapped_card_uses_index() {
+  const uint8_t uid[] = {0x51, 0x80, 0xf3, 0x83};  // First card of the default seed: 5180f383
+  runFor(1000);
+  tapCard(uid, sizeof(uid));
+  runFor(500);
+  TEST_ASSERT_EQUAL(SCAN_OK, current_page);
+}
+
+int main() {
+  fakeSdRoot();
+  buildFleet();
+  if (known_uids.empty()) {
+    printf("gen_card_fixture.py or build_card_index.py failed\n");
+    return 1;
+  }
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_index_loads);
+  RUN_TEST(test_known_cards_are_found);
+  RUN_TEST(test_unknown_cards_are_rejected);
+  RUN_TEST(test_tapped_card_uses_index);
+  RUN_TEST(test_small_heap_keeps_a_smaller_filter);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+// Daily quotas: minutes are charged when a session ends, a used-up card is
+// denied until the day rolls over, and a full usage table denies instead of
+// dropping another card's minutes.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t QUOTA_CARD[] = {0xa1, 0xb2, 0xc3, 0xd4};
+const uint8_t FREE_CARD[] = {0x12, 0x34, 0x56, 0x78};
+
+// 2 minutes a day: one 90 s session (charged as 2 started minutes) uses it up
+const char CARD_LIST[] =
+  "a1b2c3d4,Quota User With A Long Name,*,2,2030-12-31,0\n"
+  "12345678,Free User\n";
+
+const time_t CLOCK_SET = 1767200000;  // 2025-12-31 16:53:20 UTC, 23:53:20 local (UTC+7)
+
+void setUp() {}
+
+void tearDown() {
+  runFor(WARNING_TIMEOUT + 1000);  // Back on the scan screen
+}
+
+// Tap, then start the first allowed slot if the card gets that far
+PolicyResult startSession(const uint8_t *uid, uint8_t size) {
+  tapCard(uid, size);
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  if (current_page != CHOOSE_CHARGER) return current_policy_result;
+
+  pressButton(BUTTON_C);
+  pressButton(BUTTON_L);
+  TEST_ASSERT_TRUE(relays[menu_index].state);
+  return POLICY_OK;
+}
+
+void test_policy_columns_load() {
+  TEST_ASSERT_EQUAL(2, cardCount);
+  TEST_ASSERT_EQUAL_STRING("Quota User With A Long Name", cardList[0].name);
+  TEST_ASSERT_EQUAL_UINT16(2, cardList[0].policy.daily_quota);
+  TEST_ASSERT_EQUAL_UINT32(daysFromCivil(2030, 12, 31), cardList[0].policy.expiry_day);
+}
+
+void test_quota_used_up_then_rolls_over_on_uptime_days() {
+  TEST_ASSERT_FALSE(isClockValid());
+
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);  // Session times out, 2 minutes charged
+  TEST_ASSERT_EQUAL_UINT16(2, findUsageEntry("a1b2c3d4", false)->minutes);
+
+  TEST_ASSERT_EQUAL(POLICY_QUOTA_USED, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  TEST_ASSERT_EQUAL(CARD_DENIED, current_page);
+
+  // Without a clock the quota day is a day of uptime
+  runFor(86400000UL - millis() % 86400000UL + 1000);
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+}
+
+// A reset: usage saved to SD and read back, as at boot
+void reboot() {
+  checkpointUsageTable();
+  loadUsageTable();
+}
+
+void test_uptime_day_minutes_do_not_survive_a_reboot() {
+  TEST_ASSERT_FALSE(isClockValid());
+  runFor(86400000UL - millis() % 86400000UL + 1000);  // A fresh quota day
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+  TEST_ASSERT_EQUAL(POLICY_QUOTA_USED, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(WARNING_TIMEOUT + 1000);
+
+  // Day N of the next boot is not day N of this one
+  reboot();
+  TEST_ASSERT_NULL(findUsageEntry("a1b2c3d4", false));
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+}
+
+void test_quota_rolls_over_at_local_midnight() {
+  fakeSetEpoch(CLOCK_SET);
+  TEST_ASSERT_TRUE(isClockValid());
+  uint16_t day = currentDay();
+
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+  TEST_ASSERT_EQUAL(POLICY_QUOTA_USED, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  TEST_ASSERT_EQUAL(day, currentDay());
+
+  // 23:53 local plus ten minutes is the next local day, not yet the next UTC day
+  runFor(10 * 60 * 1000UL);
+  TEST_ASSERT_EQUAL(day + 1, currentDay());
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+}
+
+void test_clock_day_minutes_survive_a_reboot() {
+  TEST_ASSERT_TRUE(isClockValid());
+  runFor(24 * 3600 * 1000UL);  // A fresh quota day
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+
+  reboot();
+  TEST_ASSERT_EQUAL(POLICY_QUOTA_USED, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+}
+
+void test_cards_without_quota_are_not_tracked() {
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(FREE_CARD, sizeof(FREE_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+  TEST_ASSERT_NULL(findUsageEntry("12345678", false));
+}
+
+void test_full_usage_table_denies() {
+  // Today's entries for other cards fill the quota card's probe window
+  uint32_t start = cardHash("a1b2c3d4") % USAGE_TABLE_SIZE;
+  for (int i = 0; i < USAGE_MAX_PROBE; i++) {
+    UsageEntry &entry = usage_table.entries[(start + i) % USAGE_TABLE_SIZE];
+    snprintf(entry.uid, sizeof(entry.uid), "other%d", i);
+    entry.day = currentDay();
+    entry.minutes = 1;
+  }
+
+  TEST_ASSERT_EQUAL(POLICY_QUOTA_USED, startSession(QUOTA_CARD, sizeof(QUOTA_CARD)));
+  TEST_ASSERT_EQUAL(CARD_DENIED, current_page);
+  for (int i = 0; i < USAGE_MAX_PROBE; i++) {
+    TEST_ASSERT_EQUAL_UINT16(1, usage_table.entries[(start + i) % USAGE_TABLE_SIZE].minutes);
+  }
+
+  // Cards without a quota need no entry and still get in
+  runFor(WARNING_TIMEOUT + 1000);
+  TEST_ASSERT_EQUAL(POLICY_OK, startSession(FREE_CARD, sizeof(FREE_CARD)));
+  runFor(RELAY_ON_TIME + 1000);
+}
+
+int main() {
+  bootStation(CARD_LIST);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_policy_columns_load);
+  RUN_TEST(test_quota_used_up_then_rolls_over_on_uptime_days);
+  RUN_TEST(test_uptime_day_minutes_do_not_survive_a_reboot);
+  RUN_TEST(test_quota_rolls_over_at_local_midnight);
+  RUN_TEST(test_clock_day_minutes_survive_a_reboot);
+  RUN_TEST(test_cards_without_quota_are_not_tracked);
+  RUN_TEST(test_full_usage_table_denies);
+  return UNITY_END();
+}
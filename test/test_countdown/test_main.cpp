@@ -0,0 +1,75 @@
+// Live slot countdowns: once a screen is drawn, a countdown tick redraws only
+// the glyph cells whose character changed.
+
+#include <unity.h>
+
+#include <string>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t FIRST_CARD[] = {0xde, 0xad, 0xbe, 0xef};
+const uint8_t SECOND_CARD[] = {0x12, 0x34, 0x56, 0x78};
+
+void setUp() {}
+void tearDown() {}
+
+// Characters that differ between the countdown before and after a tick
+int changedCells(const std::string &before, const std::string &after) {
+  int changed = 0;
+  for (int i = 0; i < COUNTDOWN_LEN; i++) {
+    if (before[i] != after[i]) changed++;
+  }
+  return changed;
+}
+
+// Runs to the next countdown tick; every glyph drawn on the way must be a
+// changed cell of the countdown at row y
+void checkTicks(int y, const char *drawn, int ticks) {
+  for (int tick = 0; tick < ticks; tick++) {
+    std::string before(drawn, COUNTDOWN_LEN);
+    fakeTftGlyphs();
+    runFor(1000);
+    std::string after(drawn, COUNTDOWN_LEN);
+
+    std::vector<FakeGlyph> glyphs = fakeTftGlyphs();
+    TEST_ASSERT_TRUE(before != after);
+    TEST_ASSERT_EQUAL(changedCells(before, after), glyphs.size());
+    for (const FakeGlyph &glyph : glyphs) {
+      TEST_ASSERT_EQUAL(y, glyph.y);
+      TEST_ASSERT_NOT_EQUAL(' ', glyph.c);
+    }
+  }
+}
+
+void test_status_strip_redraws_changed_glyphs() {
+  // Start slot 1, the success screen times out back to the scan screen
+  tapCard(FIRST_CARD, sizeof(FIRST_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  pressButton(BUTTON_C);
+  pressButton(BUTTON_L);
+  TEST_ASSERT_TRUE(relays[0].state);
+  runFor(WARNING_TIMEOUT + 2000);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+  TEST_ASSERT_EQUAL_STRING_LEN(" 1:", strip_countdown[0], 3);
+
+  checkTicks(STATUS_STRIP_Y, strip_countdown[0], 12);
+}
+
+void test_menu_row_redraws_changed_glyphs() {
+  tapCard(SECOND_CARD, sizeof(SECOND_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 1500);
+  TEST_ASSERT_EQUAL(CHOOSE_CHARGER, current_page);
+  TEST_ASSERT_EQUAL_STRING_LEN(" 1:", menu_countdown[0], 3);
+
+  checkTicks(30 + 15, menu_countdown[0], 12);
+}
+
+int main() {
+  bootStation("deadbeef,First User\n12345678,Second User\n");
+
+  UNITY_BEGIN();
+  RUN_TEST(test_status_strip_redraws_changed_glyphs);
+  RUN_TEST(test_menu_row_redraws_changed_glyphs);
+  return UNITY_END();
+}
@@ -0,0 +1,117 @@
+// Long-uptime check of the heap telemetry: days of simulated use must not
+// allocate from loop() once the station has booted. The fake heap reports
+// fixed numbers, so fragmentation is not checked here.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t USER_CARD[] = {0xde, 0xad, 0xbe, 0xef};
+const uint8_t UNKNOWN_CARD[] = {0x01, 0x02, 0x03, 0x04};
+const int SOAK_VISITS = 288;        // Two days, one visit every ten minutes
+const uint32_t SOAK_SCANS = 2000;   // Back to back, each a different unknown card
+
+const char CARD_LIST[] =
+  "deadbeef,Soak User\n"
+  "aabbccdd,A name far too long for any card_list.csv line,12,120,2030-12-31,0,and an extra column\n"
+  "12345678,Second User\r\n";
+
+void setUp() {}
+void tearDown() {}
+
+void test_over_long_line_is_dropped() {
+  TEST_ASSERT_EQUAL(2, cardCount);
+  TEST_ASSERT_EQUAL_STRING("deadbeef", cardList[0].uid);
+  TEST_ASSERT_EQUAL_STRING("12345678", cardList[1].uid);
+  TEST_ASSERT_EQUAL_STRING("Second User", cardList[1].name);
+}
+
+// One visit: the user starts slot 1, a stranger taps, the session times out
+void useStation() {
+  tapCard(USER_CARD, sizeof(USER_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  TEST_ASSERT_EQUAL(CHOOSE_CHARGER, current_page);
+  pressButton(BUTTON_C);
+  TEST_ASSERT_EQUAL(CHARGER_ENABLE_CONF, current_page);
+  pressButton(BUTTON_L);
+  TEST_ASSERT_TRUE(relays[0].state);
+  runFor(WARNING_TIMEOUT + 500);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+
+  tapCard(UNKNOWN_CARD, sizeof(UNKNOWN_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+
+  runFor(RELAY_ON_TIME);
+  TEST_ASSERT_FALSE(relays[0].state);
+}
+
+// Kept from the compiler, which may drop a malloc() freed right away
+void allocate() {
+  void *volatile block = malloc(64);
+  free(block);
+}
+
+// Allocations of other tasks (storage, telemetry, lwIP) are not loop()'s
+void allocatingTask(void *param) {
+  (void)param;
+  for (int i = 0; i < 10; i++) {
+    allocate();
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  vTaskDelete(NULL);
+}
+
+void test_only_the_loop_task_is_counted() {
+  // Boot allocations stay out of the first pass
+  TEST_ASSERT_EQUAL_UINT32(heap_alloc_count, heap_stats.loop_start_allocs);
+
+  uint32_t allocs = heap_alloc_count;
+  xTaskCreatePinnedToCore(allocatingTask, "alloc", 2048, NULL, 1, NULL, 0);
+  runFor(500);
+  TEST_ASSERT_EQUAL_UINT32(allocs, heap_alloc_count);
+  TEST_ASSERT_EQUAL_UINT32(0, heap_stats.steady_alloc_loops);
+
+  allocate();
+  TEST_ASSERT_EQUAL_UINT32(allocs + 1, heap_alloc_count);
+  heap_stats.loop_start_allocs = heap_alloc_count;
+}
+
+void test_days_of_use_do_not_allocate() {
+  // First hour: caches, files and the tap history reach their working size
+  for (int visit = 0; visit < 6; visit++) {
+    useStation();
+    runFor(7 * 60 * 1000UL);
+  }
+  uint32_t warm_allocs = heap_alloc_count;
+
+  // Then two days, one visit every ten minutes, idle in between
+  for (int visit = 0; visit < SOAK_VISITS; visit++) {
+    useStation();
+    runFor(7 * 60 * 1000UL);
+  }
+
+  // And a stream of different unknown cards, one scan after the other
+  for (uint32_t scan = 0; scan < SOAK_SCANS; scan++) {
+    const uint8_t uid[] = {0x5a, (uint8_t)(scan >> 16), (uint8_t)(scan >> 8), (uint8_t)scan};
+    tapCard(uid, sizeof(uid));
+    runFor(LOADING_SCREEN_TIMEOUT + 500);
+  }
+  printf("[soak] %d visits, %u scans, %u allocations after warm-up\n", SOAK_VISITS, (unsigned)SOAK_SCANS,
+    (unsigned)(heap_alloc_count - warm_allocs));
+
+  TEST_ASSERT_EQUAL_UINT32(0, heap_stats.steady_alloc_loops);
+  TEST_ASSERT_EQUAL_UINT32(warm_allocs, heap_alloc_count);
+  TEST_ASSERT_EQUAL_UINT32(0, heap_stats.max_loop_allocs);
+}
+
+int main() {
+  bootStation(CARD_LIST);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_over_long_line_is_dropped);
+  RUN_TEST(test_only_the_loop_task_is_counted);
+  RUN_TEST(test_days_of_use_do_not_allocate);
+  return UNITY_END();
+}
@@ -0,0 +1,154 @@
+// Light sleep on the scan screen: how much of the time the CPU sleeps, and
+// how late taps and button presses are seen because of it. Reader polls take
+// their MFRC522 time (fakeReaderTiming), the CPU is awake for them.
+
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t USER_CARD[] = {0xde, 0xad, 0xbe, 0xef};
+const int TAP_SAMPLES = 100;
+
+void setUp() {}
+void tearDown() {}
+
+// Share of the next ms spent in light sleep, in percent
+double asleepPercent(unsigned long ms) {
+  fakeResetSleepStats();
+  runFor(ms);
+  return 100.0 * fakeSleepStats().slept_us / (ms * 1000.0);
+}
+
+// Runs loop() pass by pass until done() holds, returns the time since start
+template <typename Done>
+unsigned long runUntil(unsigned long start, Done done) {
+  while (!done() && (long)(millis() - start) < 5000) {
+    uint64_t before = fakeNowUs();
+    loop();
+    if (fakeNowUs() == before) fakeAdvance(1);
+  }
+  return millis() - start;
+}
+
+unsigned long percentile(std::vector<unsigned long> values, int percent) {
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * percent / 100];
+}
+
+void test_idle_scan_screen_sleeps() {
+  double awake_screen = asleepPercent(IDLE_DIM_TIMEOUT - 1000);
+  TEST_ASSERT_FALSE(idle.dimmed);
+  runFor(2000);
+  TEST_ASSERT_TRUE(idle.dimmed);
+  double dimmed = asleepPercent(10 * 60 * 1000UL);
+
+  printf("[sleep] scan screen asleep: %.1f%% with the dot animation, %.1f%% dimmed\n", awake_screen, dimmed);
+
+  // Dimmed, only the reader polls (25 ms each, READER_POLL_MAX apart) wake the CPU
+  TEST_ASSERT_GREATER_THAN(60, (int)dimmed);
+}
+
+void test_taps_are_seen_from_sleep() {
+  std::vector<unsigned long> latencies;
+  for (int sample = 0; sample < TAP_SAMPLES; sample++) {
+    runFor(rand() % (IDLE_DIM_TIMEOUT + 10000));  // Dimmed or not
+
+    // runFor() stops right after a pass, the tap lands anywhere in the next sleep
+    const uint8_t uid[] = {0xf0, (uint8_t)sample, 0x01, 0x02};
+    unsigned long tapped = millis() + rand() % READER_POLL_MAX;
+    fakeScheduleTap(tapped, RFID_SS, uid, sizeof(uid));
+    latencies.push_back(runUntil(tapped, [] { return current_page != SCAN_WAIT; }));
+
+    fakeCardRemove(RFID_SS);
+    runFor(LOADING_SCREEN_TIMEOUT + 500);
+    TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+  }
+
+  printf("[sleep] tap latency: p50=%lu ms p99=%lu ms max=%lu ms over %d taps (%u sleeps)\n",
+    percentile(latencies, 50), percentile(latencies, 99), percentile(latencies, 100), TAP_SAMPLES,
+    (unsigned)fakeSleepStats().sleeps);
+
+  // The tap waits for the next poll (READER_POLL_MAX apart) and the read itself
+  TEST_ASSERT_LESS_OR_EQUAL(READER_POLL_MAX + 25 + 10, percentile(latencies, 99));
+}
+
+void test_button_wakes_from_sleep() {
+  runFor(IDLE_DIM_TIMEOUT + 1000);
+  TEST_ASSERT_TRUE(idle.dimmed);
+
+  uint32_t gpio_wakes = fakeSleepStats().gpio_wakes;
+  Language before = current_language;
+  unsigned long pressed = millis() + 37;
+  fakeSchedulePin(pressed, BUTTON_C, LOW);
+  fakeSchedulePin(pressed + 100, BUTTON_C, HIGH);
+  unsigned long latency = runUntil(pressed, [&] { return current_language != before; });
+
+  printf("[sleep] button latency from sleep: %lu ms\n", latency);
+  TEST_ASSERT_GREATER_THAN(gpio_wakes, fakeSleepStats().gpio_wakes);
+  // Debounce (25 ms) plus a loop pass
+  TEST_ASSERT_LESS_OR_EQUAL(25 + 10, latency);
+
+  pressButton(BUTTON_C);  // Back to the first language
+}
+
+void test_charging_station_still_sleeps() {
+  tapCard(USER_CARD, sizeof(USER_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  pressButton(BUTTON_C);
+  pressButton(BUTTON_L);
+  TEST_ASSERT_TRUE(relays[0].state);
+  runFor(WARNING_TIMEOUT + 1000);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+
+  // The countdown ticks every second on top of the reader polls
+  double charging = asleepPercent(30000);
+  printf("[sleep] scan screen asleep while charging: %.1f%%\n", charging);
+  TEST_ASSERT_GREATER_THAN(40, (int)charging);
+  runFor(RELAY_ON_TIME);
+}
+
+// The UART stops in light sleep: TX is flushed before it, RX wakes the chip
+// and loses its first byte, then the station stays awake for the retry
+void test_uart_across_sleep() {
+  TEST_ASSERT_EQUAL_UINT32(0, fakeSleepStats().tx_garbled_bytes);
+
+  runFor(IDLE_DIM_TIMEOUT);
+  FakeSleepStats before = fakeSleepStats();
+  fakeSerialOutput();
+  fakeScheduleSerial(millis() + READER_POLL_MAX / 2, "time 1767200000\n");
+  runFor(READER_POLL_MAX * 2);
+  TEST_ASSERT_EQUAL_UINT32(before.uart_wakes + 1, fakeSleepStats().uart_wakes);
+  TEST_ASSERT_EQUAL_UINT32(before.lost_serial_bytes + 1, fakeSleepStats().lost_serial_bytes);
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, fakeSerialOutput().find("Commands:"));
+  TEST_ASSERT_FALSE(isClockValid());
+
+  uint32_t sleeps = fakeSleepStats().sleeps;
+  fakeScheduleSerial(millis() + SERIAL_AWAKE_TIME / 2, "time 1767200000\n");
+  runFor(SERIAL_AWAKE_TIME / 2 + 100);
+  TEST_ASSERT_EQUAL_UINT32(sleeps, fakeSleepStats().sleeps);
+  TEST_ASSERT_EQUAL_UINT32(before.lost_serial_bytes + 1, fakeSleepStats().lost_serial_bytes);
+  TEST_ASSERT_TRUE(isClockValid());
+
+  // Back to sleep once the input stops
+  runFor(SERIAL_AWAKE_TIME + 1000);
+  TEST_ASSERT_GREATER_THAN(sleeps, fakeSleepStats().sleeps);
+}
+
+int main() {
+  srand(37);
+  bootStation("deadbeef,Sleep User\n");
+  fakeReaderTiming(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_scan_screen_sleeps);
+  RUN_TEST(test_taps_are_seen_from_sleep);
+  RUN_TEST(test_button_wakes_from_sleep);
+  RUN_TEST(test_charging_station_still_sleeps);
+  RUN_TEST(test_uart_across_sleep);
+  return UNITY_END();
+}
@@ -0,0 +1,5 @@
+// Tap latency with 16 RFID readers, see ../reader_latency.h
+
+#define BOARD_READER_SIM 16
+
+#include "../reader_latency.h"
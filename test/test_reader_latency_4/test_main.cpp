@@ -0,0 +1,5 @@
+// Tap latency with 4 RFID readers, see ../reader_latency.h
+
+#define BOARD_READER_SIM 4
+
+#include "../reader_latency.h"
@@ -0,0 +1,3 @@
+// Render cost of the pre-rendered screens, see render_cost.h
+
+#include "../render_cost.h"
@@ -0,0 +1,5 @@
+// Render cost of the drawText() screens, see render_cost.h
+
+#define USE_SCREEN_IMAGES 0
+
+#include "../render_cost.h"
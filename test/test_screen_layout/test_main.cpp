@@ -0,0 +1,89 @@
+// Static screens have one layout, generated by scripts/gen_screens.py: the
+// pre-rendered images and the drawText() path must put the same pixels on the
+// panel. Built with RENDER_COST to report what each path sends over SPI.
+
+#define RENDER_COST 1
+
+#include <unity.h>
+
+#include <vector>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const char *ARG = "Charger 60V";
+
+void setUp() {}
+void tearDown() {}
+
+// String id of the %s block of a screen, -1 when it has none
+int argId(int screen) {
+  switch (screen) {
+  case SCREEN_SCAN_OK: return STR_UID_LINE;
+  case SCREEN_CONFIRM_ENABLE: return STR_CONFIRM_ENABLE;
+  case SCREEN_CONFIRM_DISABLE: return STR_CONFIRM_DISABLE;
+  default: return -1;
+  }
+}
+
+std::vector<uint16_t> snapshot() {
+  std::vector<uint16_t> pixels;
+  pixels.reserve(tft.width() * tft.height());
+  for (int y = 0; y < tft.height(); y++) {
+    for (int x = 0; x < tft.width(); x++) pixels.push_back(fakeTftPixel(x, y));
+  }
+  return pixels;
+}
+
+void test_images_match_drawn_layout() {
+  uint32_t image_spi = 0, drawn_spi = 0;
+  for (int lang = 0; lang < LANG_COUNT; lang++) {
+    current_language = (Language)lang;
+    for (int screen = 0; screen < SCREEN_COUNT; screen++) {
+      int arg_id = argId(screen);
+      const char *arg = arg_id >= 0 ? ARG : NULL;
+
+      requestImage(screen, "image", arg_id, arg);
+      while (renderSlice()) {}
+      image_spi += render_cost.spi_bytes;
+      std::vector<uint16_t> image = snapshot();
+
+      costBegin("drawn");
+      drawScreen(screen, arg);
+      drawn_spi += render_cost.spi_bytes;
+      costEnd();
+
+      char message[64];
+      snprintf(message, sizeof(message), "language %d screen %d", lang, screen);
+      TEST_ASSERT_TRUE_MESSAGE(image == snapshot(), message);
+    }
+  }
+
+  int screens = LANG_COUNT * SCREEN_COUNT;
+  printf("[screens] SPI bytes per screen: image %u, drawText %u (average of %d)\n",
+    (unsigned)(image_spi / screens), (unsigned)(drawn_spi / screens), screens);
+}
+
+void test_generated_data_size() {
+  uint32_t image_bytes = 0, text_bytes = 0;
+  for (int lang = 0; lang < LANG_COUNT; lang++) {
+    for (int screen = 0; screen < SCREEN_COUNT; screen++) {
+      image_bytes += screen_images[lang][screen].size;
+      text_bytes += screen_layouts[lang][screen].count * sizeof(ScreenText);
+    }
+  }
+  printf("[screens] flash data: images %u B + table %u B, layouts %u B + table %u B\n",
+    (unsigned)image_bytes, (unsigned)sizeof(screen_images), (unsigned)text_bytes, (unsigned)sizeof(screen_layouts));
+
+  // Half-resolution RLE keeps every image far below a raw 1-bit frame (19200 B)
+  TEST_ASSERT_LESS_THAN(LANG_COUNT * SCREEN_COUNT * 2000, image_bytes);
+}
+
+int main() {
+  bootStation(NULL);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_images_match_drawn_layout);
+  RUN_TEST(test_generated_data_size);
+  return UNITY_END();
+}
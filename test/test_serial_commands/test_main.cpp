@@ -0,0 +1,98 @@
+// Serial commands: "time <epoch>" sets the wall clock so sessions get their
+// hours and last use, and an export goes out whole, without a light sleep,
+// a blocking flush or a periodic report in the middle of the CSV.
+
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t USER_CARD[] = {0xde, 0xad, 0xbe, 0xef};
+const time_t CLOCK_SET = 1767200000;  // 2025-12-31 16:53:20 UTC
+
+void setUp() {}
+void tearDown() {}
+
+void test_time_command_sets_the_clock() {
+  TEST_ASSERT_FALSE(isClockValid());
+  fakeSerialOutput();
+
+  fakeSerialInput("time 12345\ntime 17672x\n");
+  runFor(100);
+  TEST_ASSERT_FALSE(isClockValid());
+  std::string output = fakeSerialOutput();
+  TEST_ASSERT_EQUAL(2, (int)std::count(output.begin(), output.end(), '\n'));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, output.find("Usage: time"));
+
+  fakeSerialInput("time 1767200000\n");
+  runFor(100);
+  TEST_ASSERT_TRUE(isClockValid());
+  TEST_ASSERT_TRUE(time(NULL) - CLOCK_SET <= 1);
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, fakeSerialOutput().find("Clock set"));
+}
+
+void test_sessions_get_hours_and_last_use() {
+  tapCard(USER_CARD, sizeof(USER_CARD));
+  runFor(LOADING_SCREEN_TIMEOUT + 500);
+  pressButton(BUTTON_C);
+  pressButton(BUTTON_L);
+  TEST_ASSERT_TRUE(relays[0].state);
+  runFor(RELAY_ON_TIME + 1000);
+  TEST_ASSERT_FALSE(relays[0].state);
+
+  const SlotStats &slot = analytics.slots[0];
+  uint32_t hours = 0;
+  for (int h = 0; h < 24; h++) hours += slot.hour_seconds[h];
+  TEST_ASSERT_EQUAL_UINT32(1, slot.sessions);
+  TEST_ASSERT_EQUAL_UINT32(slot.seconds, hours);
+
+  const CardStats *card = NULL;
+  for (int i = 0; i < ANALYTICS_CARDS; i++) {
+    if (strcmp(analytics.cards[i].uid, "deadbeef") == 0) card = &analytics.cards[i];
+  }
+  TEST_ASSERT_NOT_NULL(card);
+  TEST_ASSERT_TRUE(card->last_use > (uint32_t)CLOCK_SET);
+}
+
+void test_export_is_not_interrupted() {
+  runFor(IDLE_DIM_TIMEOUT);  // Idle and asleep between polls
+  uint32_t flushes = fakeSerialFlushes();
+  uint32_t sleeps = fakeSleepStats().sleeps;
+  fakeSerialOutput();
+
+  fakeSerialInput("export slots\n");
+  runFor(1);
+  TEST_ASSERT_NOT_EQUAL(EXPORT_NONE, command.export_kind);
+  heap_stats.report_timer = millis() - HEAP_REPORT_INTERVAL;  // A report is due
+  command.rx_timer = millis() - SERIAL_AWAKE_TIME;            // Only the export keeps it awake
+  // The pass that ends the export may sleep, none before it
+  unsigned long start = millis();
+  while (command.export_kind != EXPORT_NONE && millis() - start < 10000) {
+    TEST_ASSERT_EQUAL_UINT32(flushes, fakeSerialFlushes());
+    TEST_ASSERT_EQUAL_UINT32(sleeps, fakeSleepStats().sleeps);
+    runFor(1);
+  }
+  TEST_ASSERT_EQUAL(EXPORT_NONE, command.export_kind);
+
+  std::string output = fakeSerialOutput();
+  TEST_ASSERT_EQUAL(std::string::npos, output.find("[heap]"));
+  TEST_ASSERT_EQUAL(0, (int)output.find("slot,name,sessions,minutes,h00"));
+  TEST_ASSERT_EQUAL(1 + SLOT_COUNT, (int)std::count(output.begin(), output.end(), '\n'));
+
+  // The held report goes out once the export is done
+  runFor(1);
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, fakeSerialOutput().find("[heap]"));
+}
+
+int main() {
+  bootStation("deadbeef,Export User\n");
+
+  UNITY_BEGIN();
+  RUN_TEST(test_time_command_sets_the_clock);
+  RUN_TEST(test_sessions_get_hours_and_last_use);
+  RUN_TEST(test_export_is_not_interrupted);
+  return UNITY_END();
+}
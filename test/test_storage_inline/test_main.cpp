@@ -0,0 +1,60 @@
+// The storage task cannot start: setup() loads a 100k-card index inline
+// (scripts/gen_card_fixture.py, build_card_index.py) and has to keep the
+// loop watchdog fed while it does.
+
+#include <unity.h>
+
+#include <string>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Runs one of the scripts/ generators, with python3 or python
+bool runScript(const std::string &args) {
+  std::string dir = __FILE__;
+  dir = dir.substr(0, dir.find_last_of('/') + 1) + "../../scripts/";
+  std::string cmd = "python3 " + dir + args + " > /dev/null";
+  if (system(cmd.c_str()) == 0) return true;
+  cmd = "python " + dir + args + " > /dev/null";
+  return system(cmd.c_str()) == 0;
+}
+
+void test_inline_load_feeds_the_watchdog() {
+  TEST_ASSERT_TRUE(storage_inline);
+  TEST_ASSERT_TRUE(storage_loaded);
+  TEST_ASSERT_TRUE(card_index.available);
+
+  // Loading the index alone takes longer than the watchdog allows
+  uint32_t load_ms = (boot_timings[BOOT_CARDS].end - boot_timings[BOOT_CARDS].start) / 1000;
+  TEST_ASSERT_GREATER_THAN(LOOP_WDT_TIMEOUT_S * 1000UL, load_ms);
+  TEST_ASSERT_LESS_THAN(LOOP_WDT_TIMEOUT_S * 1000000ULL, fakeWdtLongestGapUs());
+}
+
+void test_station_runs_after_inline_boot() {
+  const uint8_t uid[] = {0x51, 0x80, 0xf3, 0x83};  // First card of the default seed: 5180f383
+  runFor(1000);
+  tapCard(uid, sizeof(uid));
+  runFor(500);
+  TEST_ASSERT_EQUAL(SCAN_OK, current_page);
+}
+
+int main() {
+  fakeSdRoot();
+  std::string csv = fakeSdPath("/card_list.csv");
+  if (!runScript("gen_card_fixture.py 100000 " + csv) ||
+      !runScript("build_card_index.py " + csv + " " + fakeSdPath(CARD_INDEX_PATH))) {
+    printf("gen_card_fixture.py or build_card_index.py failed\n");
+    return 1;
+  }
+
+  fakeTaskCreateFails(true);
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_inline_load_feeds_the_watchdog);
+  RUN_TEST(test_station_runs_after_inline_boot);
+  return UNITY_END();
+}
@@ -0,0 +1,58 @@
+// An SD card that mounts after BOOT_STORAGE_TIMEOUT: setup() gives up and the
+// station runs, then loop() takes the card list over once the storage task
+// is done with it.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+const uint8_t USER_CARD[] = {0xde, 0xad, 0xbe, 0xef};
+
+void setUp() {}
+void tearDown() {}
+
+void test_setup_gives_up_after_timeout() {
+  TEST_ASSERT_GREATER_OR_EQUAL(BOOT_STORAGE_TIMEOUT, millis());
+  TEST_ASSERT_FALSE(storage_loaded);
+  TEST_ASSERT_EQUAL(STR_SD_TIMEOUT, storage_error);
+  TEST_ASSERT_FALSE(sd_mounted);
+}
+
+void test_sd_bus_started_before_the_task() {
+  TEST_ASSERT_GREATER_OR_EQUAL(1, fakeSpiStarts(VSPI, 1));
+  TEST_ASSERT_EQUAL_UINT32(0, fakeSpiStarts(VSPI, 0));
+}
+
+void test_cards_wait_for_the_list() {
+  // The task is still mounting: nothing it loads is used yet
+  tapCard(USER_CARD, sizeof(USER_CARD));
+  runFor(500);
+  TEST_ASSERT_EQUAL(UNAUTHORIZED_CARD, current_page);
+  runFor(WARNING_TIMEOUT);
+  TEST_ASSERT_EQUAL(SCAN_WAIT, current_page);
+}
+
+void test_late_list_is_taken_over() {
+  runFor(20000);  // Mount done 40 s after boot
+  TEST_ASSERT_TRUE(storage_loaded);
+  TEST_ASSERT_TRUE(sd_mounted);
+  TEST_ASSERT_EQUAL(-1, storage_error);
+  TEST_ASSERT_EQUAL(1, cardCount);
+
+  tapCard(USER_CARD, sizeof(USER_CARD));
+  runFor(500);
+  TEST_ASSERT_EQUAL(SCAN_OK, current_page);
+}
+
+int main() {
+  fakeSdMountDelay(BOOT_STORAGE_TIMEOUT + 10000);
+  bootStation("deadbeef,Late User\n");
+
+  UNITY_BEGIN();
+  RUN_TEST(test_setup_gives_up_after_timeout);
+  RUN_TEST(test_sd_bus_started_before_the_task);
+  RUN_TEST(test_cards_wait_for_the_list);
+  RUN_TEST(test_late_list_is_taken_over);
+  return UNITY_END();
+}
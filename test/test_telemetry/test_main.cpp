@@ -0,0 +1,237 @@
+// Telemetry on the WiFi and MQTT fakes: lines go out in batches while the
+// broker is up, gather into one SD append per batch while it is down, and the
+// backlog is published in order once it is back. The SD work happens in the
+// telemetry task (core 0), never in loop() (core 1). A backlog file cut short
+// under the task is sent as far as it goes. Prints the publish and drain rates
+// against the broker's and the SD card's fake timing.
+
+#define TELEMETRY 1
+#define TELEMETRY_BROKER "broker.test"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../../src/main.cpp"
+#include "../station_sim.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Queues count event lines numbered from first in their value field
+void queueEvents(int first, int count) {
+  for (int i = first; i < first + count; i++) telemetryEvent("test", 0, "a1b2c3d4", i);
+}
+
+// Event values published since the last call, in order; snapshots are skipped.
+// Also returns the most lines a single message carried.
+std::vector<long> publishedValues(int *largest) {
+  std::vector<long> values;
+  *largest = 0;
+  for (const FakeMqttMessage &message : fakeMqttMessages()) {
+    int lines = (int)std::count(message.payload.begin(), message.payload.end(), '\n') + 1;
+    if (lines > *largest) *largest = lines;
+    size_t at = 0;
+    while (at < message.payload.size()) {
+      size_t end = message.payload.find('\n', at);
+      if (end == std::string::npos) end = message.payload.size();
+      std::string line = message.payload.substr(at, end - at);
+      if (line.find(",test,") != std::string::npos) values.push_back(atol(line.substr(line.rfind(',') + 1).c_str()));
+      at = end + 1;
+    }
+  }
+  return values;
+}
+
+// Reports the counters now; returns the Serial output once the report is out
+std::string takeReport() {
+  reportTelemetryStats();
+  while (report_out.length > 0) runFor(10);
+  return fakeSerialOutput();
+}
+
+// Sum of a counter over every [telemetry] report printed since the last call
+uint32_t reported(const std::string &output, const char *field) {
+  uint32_t total = 0;
+  std::string key = std::string(" ") + field + "=";
+  for (size_t at = output.find("[telemetry]"); at != std::string::npos; at = output.find("[telemetry]", at + 1)) {
+    size_t found = output.find(key, at);
+    if (found != std::string::npos && found < output.find('\n', at)) total += atol(output.c_str() + found + key.size());
+  }
+  return total;
+}
+
+void test_lines_are_published_in_order() {
+  fakeWifiUp(true);
+  fakeMqttBrokerUp(true);
+  runFor(1000);
+  TEST_ASSERT_TRUE(telemetry.online);
+  int largest;
+  publishedValues(&largest);
+
+  queueEvents(0, 12);
+  runFor(1000);
+
+  // The task takes lines as they come: a batch holds what queued up meanwhile
+  std::vector<long> values = publishedValues(&largest);
+  TEST_ASSERT_EQUAL(12, (int)values.size());
+  for (int i = 0; i < 12; i++) TEST_ASSERT_EQUAL(i, (int)values[i]);
+  TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_BATCH_MAX, largest);
+}
+
+void test_offline_lines_are_spilled_then_published() {
+  takeReport();
+
+  fakeMqttBrokerUp(false);
+  runFor(1000);
+  TEST_ASSERT_FALSE(telemetry.online);
+  uint32_t task_opens = fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0);
+
+  // A full batch is appended at once, the rest after TELEMETRY_SPILL_DELAY
+  queueEvents(100, 12);
+  runFor(1000);
+  TEST_ASSERT_EQUAL_UINT32(task_opens + 1, fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0));
+  runFor(TELEMETRY_SPILL_DELAY);
+  TEST_ASSERT_EQUAL_UINT32(task_opens + 2, fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0));
+
+  std::string backlog = fakeSdRead(TELEMETRY_BACKLOG_PATH);
+  TEST_ASSERT_EQUAL(12, (int)std::count(backlog.begin(), backlog.end(), '\n'));
+
+  // A later batch goes behind them
+  queueEvents(112, 3);
+  runFor(TELEMETRY_SPILL_DELAY + 1000);
+  TEST_ASSERT_EQUAL_UINT32(task_opens + 3, fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0));
+
+  // Back online within the longest retry delay, the backlog is sent and removed
+  fakeMqttBrokerUp(true);
+  runFor(MQTT_RETRY_MAX + 1000);
+  TEST_ASSERT_TRUE(telemetry.online);
+
+  // The backlog goes out straight from the file, several lines per message
+  int largest;
+  std::vector<long> values = publishedValues(&largest);
+  TEST_ASSERT_EQUAL(15, (int)values.size());
+  for (int i = 0; i < 15; i++) TEST_ASSERT_EQUAL(100 + i, (int)values[i]);
+  TEST_ASSERT_GREATER_THAN(1, largest);
+  TEST_ASSERT_EQUAL_STRING("", fakeSdRead(TELEMETRY_BACKLOG_PATH).c_str());
+
+  // loop() never opened the backlog
+  TEST_ASSERT_EQUAL_UINT32(0, fakeSdOpens(TELEMETRY_BACKLOG_PATH, 1));
+
+  std::string output = takeReport();
+  TEST_ASSERT_EQUAL_UINT32(15, reported(output, "spilled"));
+  TEST_ASSERT_EQUAL_UINT32(3, reported(output, "spill_writes"));
+  TEST_ASSERT_EQUAL_UINT32(15, reported(output, "drained"));
+
+  // Every queued line was published or dropped (the snapshots taken offline)
+  TEST_ASSERT_EQUAL_UINT32(reported(output, "queued"), reported(output, "published") + reported(output, "dropped"));
+}
+
+// Spills count lines numbered from first, a full batch at a time
+void spillEvents(int first, int count) {
+  for (int i = 0; i < count; i += TELEMETRY_BATCH_MAX) {
+    queueEvents(first + i, std::min(TELEMETRY_BATCH_MAX, count - i));
+    runFor(100);
+  }
+}
+
+void test_a_shortened_backlog_is_sent_as_far_as_it_goes() {
+  takeReport();
+  fakeMqttBrokerUp(false);
+  runFor(1000);
+  spillEvents(200, 16);
+  std::string backlog = fakeSdRead(TELEMETRY_BACKLOG_PATH);
+  TEST_ASSERT_EQUAL(16, (int)std::count(backlog.begin(), backlog.end(), '\n'));
+
+  // Power lost mid-append: only the first three lines made it to the card
+  size_t cut = 0;
+  for (int i = 0; i < 3; i++) cut = backlog.find('\n', cut) + 1;
+  fakeSdWrite(TELEMETRY_BACKLOG_PATH, backlog.substr(0, cut));
+
+  fakeMqttBrokerUp(true);
+  runFor(MQTT_RETRY_MAX + 1000);
+  TEST_ASSERT_TRUE(telemetry.online);
+  int largest;
+  std::vector<long> values = publishedValues(&largest);
+  TEST_ASSERT_EQUAL(3, (int)values.size());
+  for (int i = 0; i < 3; i++) TEST_ASSERT_EQUAL(200 + i, (int)values[i]);
+  TEST_ASSERT_EQUAL_STRING("", fakeSdRead(TELEMETRY_BACKLOG_PATH).c_str());
+  TEST_ASSERT_EQUAL_UINT32(backlog.size() - cut, reported(takeReport(), "lost"));
+
+  // Done with it: the task does not keep reading the file
+  uint32_t task_opens = fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0);
+  runFor(1000);
+  TEST_ASSERT_EQUAL_UINT32(task_opens, fakeSdOpens(TELEMETRY_BACKLOG_PATH, 0));
+
+  // Emptied altogether: nothing is sent, newer lines still are
+  fakeMqttBrokerUp(false);
+  runFor(1000);
+  spillEvents(300, 8);
+  fakeSdWrite(TELEMETRY_BACKLOG_PATH, "");
+  fakeMqttBrokerUp(true);
+  runFor(MQTT_RETRY_MAX + 1000);
+  queueEvents(400, 2);
+  runFor(1000);
+  values = publishedValues(&largest);
+  TEST_ASSERT_EQUAL(2, (int)values.size());
+  TEST_ASSERT_EQUAL(400, (int)values[0]);
+  TEST_ASSERT_EQUAL_UINT32(0, telemetry.backlog_bytes);
+}
+
+void test_publish_and_drain_rates() {
+  int largest;
+  takeReport();
+  publishedValues(&largest);
+
+  // Live: the queue topped up every millisecond for two seconds
+  const unsigned long LIVE_MS = 2000;
+  int next = 1000;
+  unsigned long start = millis();
+  while (millis() - start < LIVE_MS) {
+    while (uxQueueSpacesAvailable(telemetry.queue) > 0) queueEvents(next++, 1);
+    runFor(1);
+  }
+  unsigned long live_rate = publishedValues(&largest).size() * 1000 / LIVE_MS;
+  runFor(1000);
+  publishedValues(&largest);
+
+  // Backlog: spilled while the broker is down, then sent from the card
+  fakeMqttBrokerUp(false);
+  runFor(1000);
+  const int BACKLOG_LINES = 400;
+  spillEvents(2000, BACKLOG_LINES);
+  uint32_t backlog_bytes = fakeSdRead(TELEMETRY_BACKLOG_PATH).size();
+  TEST_ASSERT_EQUAL_UINT32(backlog_bytes, telemetry.backlog_bytes);
+
+  fakeMqttBrokerUp(true);
+  while (!telemetry.online) runFor(1);
+  start = millis();
+  while (telemetry.backlog_bytes > 0 && millis() - start < 60000) runFor(1);
+  unsigned long drain_ms = std::max(1UL, millis() - start);
+  std::vector<long> values = publishedValues(&largest);
+  TEST_ASSERT_EQUAL(BACKLOG_LINES, (int)values.size());
+
+  unsigned long drain_rate = (unsigned long)backlog_bytes * 1000 / drain_ms;
+  printf("[telemetry] live=%lu lines/s backlog drain=%lu B/s (%lu lines/s, %u B in %lu ms)\n",
+    live_rate, drain_rate, BACKLOG_LINES * 1000UL / drain_ms, (unsigned)backlog_bytes, drain_ms);
+
+  // The fake broker takes 1.5 ms plus 8 us a byte per publish: a full batch of
+  // about 30 byte lines every 3.5 ms (over 2000 lines/s), a full payload of
+  // backlog every 8 ms or so, SD read included (over 80 KB/s). Half of either
+  // means the task waits where it should not.
+  TEST_ASSERT_GREATER_OR_EQUAL(1000, live_rate);
+  TEST_ASSERT_GREATER_OR_EQUAL(40000, drain_rate);
+}
+
+int main() {
+  bootStation(NULL);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_lines_are_published_in_order);
+  RUN_TEST(test_offline_lines_are_spilled_then_published);
+  RUN_TEST(test_a_shortened_backlog_is_sent_as_far_as_it_goes);
+  RUN_TEST(test_publish_and_drain_rates);
+  return UNITY_END();
+}